@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <array>
+#include <vector>
+using namespace std;
+
+// Dependency-graph model of the pipeline for critical-path analysis
+// Each committed instruction adds an issue, a write-back and a commit node. Its issue waits for
+// the previous issue (one per cycle), for the ROB entry freed by the instruction robSize
+// earlier, for a reservation station of its unit and for the commit of a taken BEQ, CALL or
+// RET before it. Its write back waits for its issue, its register producers and the unit
+// latency; a load also waits for the write back of every older store still in the ROB (their
+// addresses) and takes its value from the youngest one with the same address or from memory.
+// Commit is in order, one per cycle, and a store holds it for the memory write.
+// The times are worked out as the instructions arrive, and every time carries the makeup of
+// the longest path that leads to it, so nothing is kept beyond the last robSize instructions,
+// the register producers and the stations of each unit: the memory stays bounded however
+// long the run is. Several models with different sizes and latencies can be fed the same
+// instructions to estimate what a change would do.
+
+enum PathPart {
+    PATH_ISSUE,                     // in-order issue, one instruction per cycle
+    PATH_UNIT,                      // PATH_UNIT + unit: execution in the unit (load address, store, beq, call/ret, add/sub, nand, mul)
+    PATH_MEMORY_READ = PATH_UNIT + 7,
+    PATH_MEMORY_WRITE,              // a store holding commit
+    PATH_COMMIT,                    // write back to commit and in-order commit
+    NUM_PATH_CYCLES,
+    // The edges below take no cycles of their own; the parts count how often the path uses them
+    EDGE_DATA = NUM_PATH_CYCLES,    // register producer to consumer
+    EDGE_FORWARD,                   // store to a load of the same address
+    EDGE_ORDER,                     // older store with an unresolved address to a load
+    EDGE_ROB,                       // ROB full: commit to issue robSize instructions later
+    EDGE_STATIONS,                  // all stations of the unit busy: release to issue
+    EDGE_FLUSH,                     // commit of a taken BEQ, a CALL or a RET to the next issue
+    NUM_PATH_PARTS
+};
+
+struct PathTime {
+    long long t = 0;
+    array<long long, NUM_PATH_PARTS> parts{};
+
+    PathTime after(int part, long long cycles) const {
+        PathTime p = *this;
+        p.t += cycles;
+        p.parts[part] += cycles;
+        return p;
+    }
+
+    PathTime through(int edge) const {
+        PathTime p = *this;
+        p.parts[edge]++;
+        return p;
+    }
+};
+
+inline const PathTime& latest(const PathTime& a, const PathTime& b) {
+    return b.t > a.t ? b : a;
+}
+
+struct PathParams {
+    int robSize;
+    array<int, 7> stations;
+    array<int, 7> latency;
+    int readMemory;
+    int writeMemory;
+    bool dataflowOnly = false;      // no issue, ROB, station, flush or commit limits
+};
+
+// One committed instruction as the model sees it
+struct PathInst {
+    char op;
+    int dst, src1, src2;
+    int address;                    // loads and stores
+    bool redirect;                  // taken BEQ, CALL, RET: the instructions issued after it were flushed
+};
+
+class CriticalPathModel {
+    struct Node {
+        PathTime write, commit;
+        bool store = false;
+        int address = 0;
+    };
+
+    PathParams p;
+    vector<Node> window;            // the last robSize instructions, by count % robSize
+    vector<vector<PathTime>> busy;  // per unit, the latest station releases (at most stations[u])
+    PathTime registerReady[8];
+    PathTime lastIssue, lastCommit, redirect, end;
+    bool redirected = false;
+    long long count = 0;
+
+    static int unitOf(char op) {
+        switch (op) {
+        case 'l': return 0;
+        case 't': return 1;
+        case 'b': return 2;
+        case 'c':
+        case 'r': return 3;
+        case 'a':
+        case 's': return 4;
+        case 'n': return 5;
+        default: return 6;
+        }
+    }
+
+public:
+    CriticalPathModel(const PathParams& params)
+        : p(params), window(max(params.robSize, 1)), busy(7) {
+    }
+
+    const PathParams& params() const { return p; }
+    long long instructions() const { return count; }
+
+    // Length of the critical path and what it is made of
+    const PathTime& critical() const { return end; }
+
+    void add(const PathInst& in) {
+        int unit = unitOf(in.op);
+        Node& slot = window[count % window.size()];
+
+        PathTime issue;
+        if (!p.dataflowOnly && count > 0) {
+            issue = lastIssue.after(PATH_ISSUE, 1);
+            if (count >= (long long)window.size())
+                issue = latest(issue, slot.commit.through(EDGE_ROB));
+            vector<PathTime>& held = busy[unit];
+            if ((int)held.size() >= p.stations[unit]) {
+                auto first = min_element(held.begin(), held.end(), [](const PathTime& a, const PathTime& b) { return a.t < b.t; });
+                issue = latest(issue, first->through(EDGE_STATIONS));
+            }
+            if (redirected)
+                issue = latest(issue, redirect.through(EDGE_FLUSH));
+        }
+        redirected = false;
+
+        PathTime start = issue.after(PATH_ISSUE, 1);
+        int sources[2] = { in.src1, in.op == 'l' || in.op == 'r' ? -1 : in.src2 };
+        if (in.op == 'c')
+            sources[0] = -1;
+        for (int src : sources)
+            if (src > 0)
+                start = latest(start, registerReady[src].through(EDGE_DATA));
+        PathTime done = start.after(PATH_UNIT + unit, p.latency[unit] - 1);
+
+        PathTime write;
+        if (in.op == 'l') {
+            const Node* forward = nullptr;
+            long long older = min<long long>(count, window.size() - 1);
+            for (long long k = 1; k <= older; k++) {
+                const Node& n = window[(count - k) % window.size()];
+                if (!n.store)
+                    continue;
+                if (!p.dataflowOnly)
+                    done = latest(done, n.write.through(EDGE_ORDER));
+                if (!forward && n.address == in.address && (p.dataflowOnly || n.commit.t >= done.t))
+                    forward = &n;
+            }
+            if (forward)
+                write = latest(done, forward->write.through(EDGE_FORWARD)).after(PATH_UNIT + unit, 1);
+            else
+                write = done.after(PATH_MEMORY_READ, p.readMemory).after(PATH_UNIT + unit, 1);
+        }
+        else
+            write = done.after(PATH_UNIT + unit, 1);
+
+        PathTime commit = write.after(PATH_COMMIT, 1);
+        if (!p.dataflowOnly && count > 0)
+            commit = latest(commit, lastCommit.after(PATH_COMMIT, 1));
+        if (in.op == 't')
+            commit = commit.after(PATH_MEMORY_WRITE, p.writeMemory - 1);
+
+        if (in.dst > 0 && in.op != 't' && in.op != 'b' && in.op != 'r')
+            registerReady[in.dst] = write;
+        vector<PathTime>& held = busy[unit];
+        const PathTime& release = in.op == 't' ? commit : write;
+        if ((int)held.size() < p.stations[unit])
+            held.push_back(release);
+        else if (!held.empty()) {
+            auto first = min_element(held.begin(), held.end(), [](const PathTime& a, const PathTime& b) { return a.t < b.t; });
+            if (release.t > first->t)
+                *first = release;
+        }
+        if (in.redirect) {
+            redirect = commit;
+            redirected = true;
+        }
+
+        slot.write = write;
+        slot.commit = commit;
+        slot.store = in.op == 't';
+        slot.address = in.address;
+        lastIssue = issue;
+        lastCommit = commit;
+        end = latest(end, p.dataflowOnly ? write : commit);
+        count++;
+    }
+};
@@ -0,0 +1,88 @@
+#include <string>
+using namespace std;
+
+// Microarchitectural events counted by the pipeline for the energy estimate. The functional
+// unit events follow the reservation-station groups (ADD and SUB share the adder, CALL and RET
+// the call unit); lookups and wakeups are counted per entry compared.
+enum EnergyEvent {
+    EV_ISSUE,           // instruction issued (decode, rename, RS write)
+    EV_ROB_READ,        // ROB entry read at commit
+    EV_ROB_WRITE,       // ROB entry allocated, result or target written
+    EV_ROB_LOOKUP,      // ROB entry compared while looking up a source operand (findVal)
+    EV_WAKEUP,          // RS entry compared against a result broadcast on the CDB
+    EV_LOAD_OP,
+    EV_STORE_OP,
+    EV_BRANCH_OP,
+    EV_CALL_OP,
+    EV_ADD_OP,
+    EV_NAND_OP,
+    EV_MUL_OP,
+    EV_MEM_READ,
+    EV_MEM_WRITE,
+    EV_FLUSH,           // pipeline flush or load replay
+    NUM_ENERGY_EVENTS
+};
+
+// Per-event energy (pJ), leakage per cycle (pJ) and clock; the defaults are rough figures for a
+// small out-of-order core and only meant for comparing configurations with each other
+struct EnergyParams {
+    double event[NUM_ENERGY_EVENTS] = { 2.0, 1.5, 1.8, 0.3, 0.1, 1.0, 1.0, 0.8, 0.8, 1.0, 0.6, 8.0, 10.0, 12.0, 5.0 };
+    double baseLeakage = 5.0;           // per cycle, everything outside the ROB and the stations
+    double robEntryLeakage = 0.2;       // per ROB entry per cycle
+    double rsEntryLeakage = 0.15;       // per reservation station per cycle
+    double clockGHz = 1.0;
+
+    static const char* name(int e) {
+        static const char* names[NUM_ENERGY_EVENTS] = {
+            "issue", "ROB read", "ROB write", "ROB lookup compare", "RS wakeup compare",
+            "load unit operation", "store unit operation", "branch unit operation", "call/ret unit operation",
+            "add/sub unit operation", "nand unit operation", "mul unit operation",
+            "memory read", "memory write", "flush"
+        };
+        return names[e];
+    }
+};
+
+struct EnergyCounters {
+    long long events[NUM_ENERGY_EVENTS] = {};
+
+    void count(EnergyEvent e, long long n = 1) {
+        events[e] += n;
+    }
+
+    static EnergyEvent unitEvent(char op) {
+        switch (op) {
+        case 'l': return EV_LOAD_OP;
+        case 't': return EV_STORE_OP;
+        case 'b': return EV_BRANCH_OP;
+        case 'c':
+        case 'r': return EV_CALL_OP;
+        case 'a':
+        case 's': return EV_ADD_OP;
+        case 'n': return EV_NAND_OP;
+        default: return EV_MUL_OP;
+        }
+    }
+};
+
+struct EnergyReport {
+    double dynamicPJ = 0;
+    double leakagePJ = 0;
+    double timeNs = 0;
+
+    double energyNJ() const { return (dynamicPJ + leakagePJ) / 1000; }
+    double powerMW() const { return timeNs > 0 ? (dynamicPJ + leakagePJ) / timeNs : 0; }    // pJ/ns = mW
+    double edp() const { return energyNJ() * timeNs; }                                          // nJ*ns
+};
+
+// Leakage scales with the sizes of the ROB and the reservation stations
+inline EnergyReport estimateEnergy(const EnergyParams& p, const EnergyCounters& c, long long cycles,
+    int robSize, int reservationStations) {
+    EnergyReport r;
+    for (int e = 0; e < NUM_ENERGY_EVENTS; e++)
+        r.dynamicPJ += p.event[e] * c.events[e];
+    double leakagePerCycle = p.baseLeakage + p.robEntryLeakage * robSize + p.rsEntryLeakage * reservationStations;
+    r.leakagePJ = leakagePerCycle * cycles;
+    r.timeNs = cycles / p.clockGHz;
+    return r;
+}
@@ -0,0 +1,37 @@
+#include <vector>
+using namespace std;
+
+// Direct-mapped instruction cache; addresses are instruction indices (pc)
+class ICache {
+    int lineSize;           // instructions per line
+    vector<int> tags;       // line held by each set, -1 if empty
+
+public:
+    long long accesses = 0;
+    long long misses = 0;
+
+    ICache(int lines = 16, int lineInstructions = 4)
+        : lineSize(lineInstructions), tags(lines, -1) {
+    }
+
+    int lineOf(int pc) const {
+        return pc / lineSize;
+    }
+
+    // Returns true on a hit; a miss fills the line
+    bool access(int pc) {
+        accesses++;
+        int line = lineOf(pc);
+        int set = line % tags.size();
+        if (tags[set] == line)
+            return true;
+        misses++;
+        tags[set] = line;
+        return false;
+    }
+};
+
+struct FetchedInst {
+    int pc;
+    int readyCycle;         // cycle it leaves decode and can be issued
+};
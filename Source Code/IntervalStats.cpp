@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+using namespace std;
+
+// Statistics of one sampling interval; all fields cover only the cycles since the previous sample
+struct IntervalSample {
+    int64_t cycle;              // cycle at the end of the interval
+    int64_t cycles;             // length of the interval
+    int64_t committed;          // instructions committed in the interval
+    double ipc;
+    double mispredRate;         // percent of the branches committed in the interval
+    double robOccupancy;        // average ROB entries in use
+    double rsOccupancy;         // average busy reservation stations
+    double loadLatency;         // average cycles from issue to write back of the loads written back
+};
+
+// Buffered writer for interval samples, either CSV (one line per sample) or binary (a 12-byte
+// header "ISTA", version, field count, then raw IntervalSample records). Samples are kept in
+// memory and written out when the buffer fills or a second has passed since the last write,
+// so a long run can be followed while it goes without a write per sample.
+class StatsStream {
+    static const size_t BUFFER_BYTES = 1 << 16;
+
+    ofstream out;
+    bool binary = false;
+    string buffer;
+    chrono::steady_clock::time_point lastFlush;
+
+public:
+    string path;
+    long long samples = 0;
+
+    bool open(const string& file, bool bin) {
+        path = file;
+        binary = bin;
+        out.open(path, bin ? ios::binary | ios::trunc : ios::trunc);
+        if (!out)
+            return false;
+        if (binary) {
+            int32_t header[3] = { 0x41545349, 1, 8 };       // "ISTA" little-endian
+            buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+        }
+        else
+            buffer += "cycle,cycles,committed,ipc,mispred_pct,rob_occupancy,rs_occupancy,load_latency\n";
+        lastFlush = chrono::steady_clock::now();
+        return true;
+    }
+
+    bool isOpen() const {
+        return out.is_open();
+    }
+
+    void write(const IntervalSample& s) {
+        samples++;
+        if (binary)
+            buffer.append(reinterpret_cast<const char*>(&s), sizeof(s));
+        else
+            buffer += to_string(s.cycle) + "," + to_string(s.cycles) + "," + to_string(s.committed) + ","
+                + to_string(s.ipc) + "," + to_string(s.mispredRate) + "," + to_string(s.robOccupancy) + ","
+                + to_string(s.rsOccupancy) + "," + to_string(s.loadLatency) + "\n";
+        auto now = chrono::steady_clock::now();
+        if (buffer.size() >= BUFFER_BYTES || now - lastFlush >= chrono::seconds(1))
+            flush();
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        buffer.clear();
+        lastFlush = chrono::steady_clock::now();
+    }
+
+    void close() {
+        if (!out.is_open())
+            return;
+        flush();
+        out.close();
+    }
+};
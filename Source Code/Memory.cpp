@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+using namespace std;
+
+// Sparse word-addressed data memory over a 32-bit address space.
+// A two-level page table (1024 directory entries x 1024 pages of 4K words) is filled in lazily:
+// every page that was never written is the one shared zero page, and a page gets its own copy
+// on its first write (copy-on-write), so the footprint follows the touched working set.
+// Copying a PagedMemory shares all pages until one of the copies writes to them.
+class PagedMemory {
+public:
+    static const int PAGE_BITS = 12;
+    static const int TABLE_BITS = 10;
+    static const uint32_t PAGE_WORDS = 1u << PAGE_BITS;
+
+private:
+    static const uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+    static const uint32_t DIRECTORY_SIZE = 1u << (32 - PAGE_BITS - TABLE_BITS);
+
+    typedef array<int16_t, PAGE_WORDS> Page;
+    typedef array<shared_ptr<Page>, TABLE_SIZE> Table;
+
+    array<shared_ptr<Table>, DIRECTORY_SIZE> directory;     // null: every page in the range is zero
+
+    static const shared_ptr<Page>& zeroPage() {
+        static const shared_ptr<Page> zero = make_shared<Page>();
+        return zero;
+    }
+
+public:
+    int16_t read(uint32_t address) const {
+        const Table* table = directory[address >> (PAGE_BITS + TABLE_BITS)].get();
+        if (!table)
+            return 0;
+        return (*(*table)[(address >> PAGE_BITS) & (TABLE_SIZE - 1)])[address & (PAGE_WORDS - 1)];
+    }
+
+    void write(uint32_t address, int16_t value) {
+        shared_ptr<Table>& table = directory[address >> (PAGE_BITS + TABLE_BITS)];
+        if (!table) {
+            if (value == 0)
+                return;
+            table = make_shared<Table>();
+            table->fill(zeroPage());
+        }
+        else if (table.use_count() > 1)
+            table = make_shared<Table>(*table);
+        shared_ptr<Page>& page = (*table)[(address >> PAGE_BITS) & (TABLE_SIZE - 1)];
+        if (page.use_count() > 1) {                 // the zero page or a page shared with a copy
+            if (page == zeroPage() && value == 0)
+                return;
+            page = make_shared<Page>(*page);
+        }
+        (*page)[address & (PAGE_WORDS - 1)] = value;
+    }
+
+    // FNV-1a over the address and contents of every page that is not all zeros, so the same
+    // contents give the same hash however they were written
+    uint64_t hash() const {
+        uint64_t h = 14695981039346656037ull;
+        for (uint32_t d = 0; d < DIRECTORY_SIZE; d++) {
+            if (!directory[d])
+                continue;
+            for (uint32_t t = 0; t < TABLE_SIZE; t++) {
+                const shared_ptr<Page>& page = (*directory[d])[t];
+                if (page == zeroPage() || all_of(page->begin(), page->end(), [](int16_t w) { return w == 0; }))
+                    continue;
+                h = (h ^ ((d << TABLE_BITS) | t)) * 1099511628211ull;
+                for (int16_t w : *page)
+                    h = (h ^ (uint16_t)w) * 1099511628211ull;
+            }
+        }
+        return h;
+    }
+};
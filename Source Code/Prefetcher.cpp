@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+// PC-indexed stride prefetcher
+// The reference prediction table keeps, per load pc, the last address, the last stride and a
+// 2-bit confidence counter. Once a load's stride has repeated (confidence >= 2), each demand
+// access prefetches address + distance * stride into a small prefetch buffer; a later demand
+// load to a buffered address only waits for the rest of the prefetch, or hitTime if it is done.
+// The buffer models timing only: loads still read their value from memory.
+class StridePrefetcher {
+    struct RPTEntry {
+        int pc = -1;
+        int lastAddress = 0;
+        int stride = 0;
+        int confidence = 0;
+    };
+    struct Prefetch {
+        int address;
+        int readyCycle;
+        bool used;
+    };
+
+    vector<RPTEntry> table;
+    vector<Prefetch> buffer;        // FIFO, oldest first
+    int bufferSize;
+    int distance;
+    int hitTime;
+
+    void insert(int address, int readyCycle) {
+        for (auto& p : buffer)
+            if (p.address == address && !p.used)
+                return;
+        if ((int)buffer.size() == bufferSize)
+            buffer.erase(buffer.begin());
+        buffer.push_back({ address, readyCycle, false });
+        issued++;
+    }
+
+public:
+    long long demands = 0;          // demand loads that went to memory
+    long long issued = 0;           // prefetches sent to memory
+    long long hits = 0;             // demand loads that found their address in the buffer
+    long long timely = 0;           // hits whose prefetch had already completed
+    long long savedCycles = 0;
+
+    StridePrefetcher(int entries = 16, int prefetchDistance = 2, int bufferEntries = 8, int hitLatency = 1)
+        : table(entries), bufferSize(bufferEntries), distance(prefetchDistance), hitTime(hitLatency) {
+    }
+
+    // A demand load of pc to address starts its memory access this cycle and would take
+    // missLatency cycles; returns the latency it actually sees. copyValid is false when the
+    // memory system says any copy of the address is stale (coherence miss).
+    int demand(int pc, int address, int cycle, int missLatency, bool copyValid = true) {
+        demands++;
+        int latency = missLatency;
+        for (auto& p : buffer)
+            if (p.address == address && !p.used) {
+                p.used = true;
+                if (!copyValid)
+                    break;
+                hits++;
+                if (p.readyCycle <= cycle)
+                    timely++;
+                latency = max(hitTime, p.readyCycle - cycle);
+                if (latency > missLatency)
+                    latency = missLatency;
+                savedCycles += missLatency - latency;
+                break;
+            }
+
+        RPTEntry& e = table[pc % table.size()];
+        if (e.pc != pc) {
+            e.pc = pc;
+            e.lastAddress = address;
+            e.stride = 0;
+            e.confidence = 0;
+            return latency;
+        }
+        int stride = address - e.lastAddress;
+        if (stride == e.stride) {
+            if (e.confidence < 3)
+                e.confidence++;
+        }
+        else if (e.confidence > 0)
+            e.confidence--;
+        else
+            e.stride = stride;
+        e.lastAddress = address;
+        if (e.confidence >= 2 && e.stride != 0)
+            insert(address + distance * e.stride, cycle + missLatency);
+        return latency;
+    }
+};
@@ -17,18 +17,20 @@ struct ROBEntry {
     int16_t value;
     bool ready;
     int instId;         // just to record commit time of certain instruction
+    int thread;         // hardware context that issued it (SMT)
 
     ROBEntry()
-        : busy(false), type(' '), destination(-1), value(0), ready(false), instId(-1) {
+        : busy(false), type(' '), destination(-1), value(0), ready(false), instId(-1), thread(0) {
     }
 
-    ROBEntry(char typ, int dest, int val, int pc) {
+    ROBEntry(char typ, int dest, int val, int pc, int t) {
         busy = true;
         type = typ;
         destination = dest;
         value = val;
         ready = false;
         instId = pc;
+        thread = t;
     }
 };
 
@@ -39,6 +41,7 @@ class ROB {
     int tail;
     vector<ROBEntry> entries;
     int count;          // Number of elements currently in ROB
+    vector<int> threadCount;    // live (not squashed) entries per hardware context
 
 public:
 
@@ -58,24 +61,31 @@ public:
         return (count == 0);
     }
 
-    int allocate(char type, int dest, int pc) {
+    int countOf(int thread) const {
+        return thread < (int)threadCount.size() ? threadCount[thread] : 0;
+    }
+
+    int allocate(char type, int dest, int pc, int thread = 0) {
         if (isFull()) {
             cout << "Error: ROB is full, can't allocate\n";
             return -1;
         }
 
-        entries[tail] = ROBEntry(type, dest, 0, pc);
+        if (thread >= (int)threadCount.size())
+            threadCount.resize(thread + 1, 0);
+        threadCount[thread]++;
+        entries[tail] = ROBEntry(type, dest, 0, pc, thread);
         int index = tail;
         tail = (tail + 1) % size;
         count++;
         return index;
     }
 
-    bool findVal(int dest, int16_t& value) {
+    bool findVal(int dest, int16_t& value, int thread = 0) {
         int index = tail;
         do {
             index = (index + size - 1) % size;
-            if (entries[index].ready && entries[index].type != 's' && entries[index].destination == dest) {
+            if (entries[index].ready && writesRegister(entries[index].type) && entries[index].thread == thread && entries[index].destination == dest) {
                 value = entries[index].value;
                 return true;
             }
@@ -84,6 +94,12 @@ public:
         return false;
     }
 
+    // Only these entries hold a register number in destination; stores and control
+    // instructions keep a memory address or a target pc there
+    static bool writesRegister(char type) {
+        return type == 'l' || type == 'a' || type == 's' || type == 'n' || type == 'm';
+    }
+
     void markReady(int index, int16_t val) {
         entries[index].ready = true;
         entries[index].value = val;
@@ -104,7 +120,7 @@ public:
     int getFirst(vector<int> ready) {
         vector<bool> val(size, false);
         int options = 0, index;
-        for (int i=0;i<ready.size();i++)
+        for (int i = 0; i < (int)ready.size(); i++)
             if (ready[i] >= 0) {
                 val[ready[i]] = true;
                 index = i;
@@ -135,13 +151,15 @@ public:
 
     bool canCommit(int& front) const {
         front = head;
-        return entries[head].ready;
+        return count > 0 && entries[head].ready;
     }
 
     void commit() {
         if (isEmpty())
             return;
         entries[head].busy = false;
+        if (entries[head].type != 'x')
+            threadCount[entries[head].thread]--;
         if (count == 1) {
             head = 0;
             tail = 0;
@@ -155,12 +173,89 @@ public:
         return entries[head].instId;
     }
 
+    int getInstId(int index) const {
+        return entries[index].instId;
+    }
+
+    bool isBusy(int index) const {
+        return entries[index].busy;
+    }
+
+    int age(int index) const {          // 0 for the head, count - 1 for the youngest entry
+        return (index - head + size) % size;
+    }
+
+    // Live entries from the oldest to the youngest
+    vector<int> inOrder() const {
+        vector<int> order;
+        for (int n = 0, index = head; n < count; n++, index = (index + 1) % size)
+            order.push_back(index);
+        return order;
+    }
+
+    // Removes the entry at index and everything younger; returns how many were removed
+    int flushFrom(int index) {
+        int removed = 0;
+        while (count > 0 && age(index) < count) {
+            count--;
+            tail = (tail + size - 1) % size;
+            entries[tail].busy = false;
+            if (entries[tail].type != 'x')
+                threadCount[entries[tail].thread]--;
+            removed++;
+        }
+        if (count == 0)
+            head = tail;
+        return removed;
+    }
+
+    // Read-only views for the debug journal
+    int getHead() const { return head; }
+    int getTail() const { return tail; }
+    int getCount() const { return count; }
+    int getSize() const { return size; }
+    const ROBEntry& entryAt(int index) const { return entries[index]; }
+
+    int getThread(int index) const {
+        return entries[index].thread;
+    }
+
+    bool isSquashed(int index) const {
+        return entries[index].busy && entries[index].type == 'x';
+    }
+
+    // SMT: squash the entries of one thread younger than the head; the other threads'
+    // entries stay in place and squashed ones are dropped when they reach the head
+    void squashThread(int thread) {
+        int index = head;
+        for (int n = 1; n < count; n++) {
+            index = (index + 1) % size;
+            if (entries[index].thread == thread && entries[index].type != 'x') {
+                entries[index].type = 'x';
+                entries[index].ready = true;
+                threadCount[thread]--;
+            }
+        }
+        while (count > 1 && entries[(tail + size - 1) % size].type == 'x') {
+            tail = (tail + size - 1) % size;
+            entries[tail].busy = false;
+            count--;
+        }
+    }
+
+    void dropSquashed() {
+        while (!isEmpty() && entries[head].type == 'x')
+            commit();
+    }
+
     void flushAfter() {
-        while (tail != head)
+        while (count > 1)       // everything but the head, also when the ROB is full
         {
             count--;
             tail = (tail + size - 1) % size;
             entries[tail].busy = false;
+            if (entries[tail].type != 'x')
+                threadCount[entries[tail].thread]--;
         }
     }
 
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// On-disk cache of simulation results
+// An entry is one file, <dir>/<key as 16 hex digits>.result, holding the text that identifies
+// the run (program, memory and configuration), the printed results and, optionally, the trace
+// the run recorded. The key is a hash of the identity, and a lookup only hits if the stored
+// identity is the same text. Entries are written to a uniquely named temporary file and renamed
+// into place, so a reader in another process sees a whole entry or none. A hit touches the
+// file's modification time; a store then removes the least recently used other entries until
+// the directory is under maxBytes, and temporary files left behind by runs that were killed.
+
+struct ResultHeader {
+    int32_t magic = 0x544c5352;     // "RSLT" little-endian
+    int32_t version = 1;
+    uint64_t key = 0;
+    int64_t identityBytes = 0;
+    int64_t resultsBytes = 0;
+    int64_t traceBytes = 0;
+};
+
+class ResultCache {
+    filesystem::path dir;
+    long long maxBytes = 0;
+
+    filesystem::path entryPath(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.result", (unsigned long long)key);
+        return dir / name;
+    }
+
+    void evict(const filesystem::path& keep) {
+        struct Entry {
+            filesystem::path path;
+            filesystem::file_time_type used;
+            long long bytes;
+        };
+        vector<Entry> entries;
+        error_code ec;
+        long long total = filesystem::file_size(keep, ec);
+        if (ec)
+            total = 0;
+        auto stale = filesystem::file_time_type::clock::now() - chrono::hours(1);
+        for (const auto& f : filesystem::directory_iterator(dir, ec)) {
+            auto used = filesystem::last_write_time(f.path(), ec);
+            if (ec)
+                continue;                       // removed by another process meanwhile
+            if (f.path().extension() == ".tmp") {
+                if (used < stale)
+                    filesystem::remove(f.path(), ec);
+                continue;
+            }
+            if (f.path().extension() != ".result" || f.path() == keep)
+                continue;
+            long long bytes = filesystem::file_size(f.path(), ec);
+            if (ec)
+                continue;
+            entries.push_back({ f.path(), used, bytes });
+            total += bytes;
+        }
+        if (total <= maxBytes)
+            return;
+        sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const Entry& e : entries) {
+            if (total <= maxBytes)
+                break;
+            if (filesystem::remove(e.path, ec))
+                evicted++;
+            total -= e.bytes;
+        }
+    }
+
+public:
+    string file;                    // entry of the last lookup or store
+    long long evicted = 0;          // entries removed by the last store
+
+    // Returns an error message, or an empty string if the cache can be used
+    string open(const string& directory, long long maxSize) {
+        dir = directory;
+        maxBytes = maxSize;
+        error_code ec;
+        filesystem::create_directories(dir, ec);
+        if (!filesystem::is_directory(dir, ec))
+            return "Could not create the cache directory " + directory;
+        return "";
+    }
+
+    bool lookup(uint64_t key, const string& identity, string& results, string& trace) {
+        filesystem::path path = entryPath(key);
+        file = path.string();
+        ifstream in(path, ios::binary);
+        ResultHeader h, expected;
+        if (!in || !in.read(reinterpret_cast<char*>(&h), sizeof(h)) || h.magic != expected.magic
+            || h.version != expected.version || h.key != key || h.identityBytes != (int64_t)identity.size())
+            return false;
+        string stored(h.identityBytes, '\0');
+        if (!in.read(&stored[0], stored.size()) || stored != identity)
+            return false;
+        streamoff position = in.tellg();    // the size of the file opened, which a store may have replaced since
+        in.seekg(0, ios::end);
+        long long fileBytes = in.tellg();
+        in.seekg(position);
+        if (!in || h.resultsBytes < 0 || h.traceBytes < 0
+            || h.resultsBytes > fileBytes || h.traceBytes > fileBytes
+            || (long long)sizeof(h) + h.identityBytes + h.resultsBytes + h.traceBytes != fileBytes)
+            return false;                   // a damaged or foreign entry is a miss
+        results.assign(h.resultsBytes, '\0');
+        trace.assign(h.traceBytes, '\0');
+        if (!in.read(&results[0], results.size()) || !in.read(&trace[0], trace.size()))
+            return false;
+        error_code ec;
+        filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    bool store(uint64_t key, const string& identity, const string& results, const string& trace) {
+        filesystem::path path = entryPath(key);
+        file = path.string();
+        random_device rd;
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%08x%08x.tmp", rd(), rd());
+        filesystem::path temporary = path;
+        temporary += suffix;
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            ResultHeader h;
+            h.key = key;
+            h.identityBytes = identity.size();
+            h.resultsBytes = results.size();
+            h.traceBytes = trace.size();
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(identity.data(), identity.size());
+            out.write(results.data(), results.size());
+            out.write(trace.data(), trace.size());
+            if (!out.flush()) {
+                out.close();
+                error_code ec;
+                filesystem::remove(temporary, ec);
+                return false;
+            }
+        }
+        error_code ec;
+        filesystem::rename(temporary, path, ec);
+        if (ec) {
+            filesystem::remove(temporary, ec);
+            return false;
+        }
+        evicted = 0;
+        evict(path);
+        return true;
+    }
+};
@@ -0,0 +1,48 @@
+#include <vector>
+using namespace std;
+
+// Store-set memory dependence predictor
+// A load and the stores it has conflicted with share a store set id in the SSIT (indexed by pc).
+// A load only waits for older stores with unknown addresses that are in its own store set;
+// all other unresolved stores are predicted independent and the load goes ahead of them.
+class StoreSetPredictor {
+    static const int TABLE_SIZE = 1024;
+    static const int CLEAR_INTERVAL = 100000;   // cycles between SSIT clears, so stale sets fade out
+
+    vector<int> ssit;       // store set id per pc, -1 if the instruction has none
+    int nextId;
+
+public:
+    long long earlyLoads = 0;       // loads that went ahead of an unresolved store
+    long long violations = 0;
+    long long squashed = 0;         // instructions squashed to replay violating loads
+    long long lostCycles = 0;       // issue-to-replay cycles of the violating loads
+
+    StoreSetPredictor() : ssit(TABLE_SIZE, -1), nextId(0) {
+    }
+
+    bool sameSet(int loadPc, int storePc) const {
+        int id = ssit[loadPc % TABLE_SIZE];
+        return id != -1 && id == ssit[storePc % TABLE_SIZE];
+    }
+
+    // Put both instructions in one store set, merging into the smaller id if both have one
+    void recordViolation(int loadPc, int storePc) {
+        int& l = ssit[loadPc % TABLE_SIZE];
+        int& s = ssit[storePc % TABLE_SIZE];
+        violations++;
+        if (l == -1 && s == -1)
+            l = s = nextId++;
+        else if (l == -1)
+            l = s;
+        else if (s == -1)
+            s = l;
+        else
+            l = s = (l < s ? l : s);
+    }
+
+    void tick(int cycle) {
+        if (cycle > 0 && cycle % CLEAR_INTERVAL == 0)
+            ssit.assign(TABLE_SIZE, -1);
+    }
+};
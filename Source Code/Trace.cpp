@@ -0,0 +1,177 @@
+#include <cstdint>
+#include <fstream>
+#include <string>
+using namespace std;
+
+// Committed-instruction trace
+// Only the outcomes the program's values decide are stored, in commit order: a byte per BEQ
+// (taken or not), the address of every load and store as a zigzag varint of the difference
+// to the previous one, and the target of every RET as a zigzag varint. The pcs, CALL targets
+// and everything else follow from the program, so most instructions take no space at all.
+// The file starts with a 40-byte header: "TRCE", version, pcStart, a hash of the program, the
+// number of committed instructions and the number of outcomes (the last two are filled in
+// when the writer closes). Both ends go through a fixed buffer, so a trace of any length is
+// written and read in constant memory.
+
+struct TraceHeader {
+    int32_t magic = 0x45435254;     // "TRCE" little-endian
+    int32_t version = 1;
+    int32_t pcStart = 0;
+    int32_t unused = 0;
+    uint64_t programHash = 0;
+    int64_t committed = 0;
+    int64_t outcomes = 0;
+};
+
+static_assert(sizeof(TraceHeader) == 40, "the trace header is part of the file format");
+
+class TraceWriter {
+    static const size_t BUFFER_BYTES = 1 << 16;
+
+    ofstream out;
+    string buffer;
+    int lastAddress = 0;
+
+    void put(uint32_t v) {
+        while (v >= 0x80) {
+            buffer += char(v | 0x80);
+            v >>= 7;
+        }
+        buffer += char(v);
+        header.outcomes++;
+        if (buffer.size() >= BUFFER_BYTES)
+            flush();
+    }
+
+    static uint32_t zigzag(int v) {
+        return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        bytes += buffer.size();
+        buffer.clear();
+    }
+
+public:
+    TraceHeader header;
+    string path;
+    long long bytes = 0;
+
+    bool open(const string& file, int pcStart, uint64_t programHash) {
+        path = file;
+        out.open(path, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        header = TraceHeader();
+        header.pcStart = pcStart;
+        header.programHash = programHash;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        bytes = sizeof(header);
+        return true;
+    }
+
+    bool isOpen() const {
+        return out.is_open();
+    }
+
+    void committed() {
+        header.committed++;
+    }
+
+    void branch(bool taken) {
+        put(taken);
+    }
+
+    void address(int a) {
+        put(zigzag(a - lastAddress));
+        lastAddress = a;
+    }
+
+    void target(int t) {
+        put(zigzag(t));
+    }
+
+    void close() {
+        if (!out.is_open())
+            return;
+        flush();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+    }
+};
+
+class TraceReader {
+    static const size_t BUFFER_BYTES = 1 << 16;
+
+    ifstream in;
+    char buffer[BUFFER_BYTES];
+    size_t size = 0, position = 0;
+    int lastAddress = 0;
+
+    bool readByte(uint8_t& b) {
+        if (position == size) {
+            in.read(buffer, BUFFER_BYTES);
+            size = in.gcount();
+            position = 0;
+            if (size == 0)
+                return false;
+        }
+        b = buffer[position++];
+        return true;
+    }
+
+    uint32_t get() {
+        uint32_t v = 0;
+        uint8_t b;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (!readByte(b)) {
+                exhausted = true;
+                return 0;
+            }
+            v |= uint32_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        consumed++;
+        return v;
+    }
+
+    static int unzigzag(uint32_t v) {
+        return int(v >> 1) ^ -int(v & 1);
+    }
+
+public:
+    TraceHeader header;
+    string path;
+    long long consumed = 0;         // outcomes read so far
+    bool exhausted = false;         // an outcome was asked for past the end of the trace
+
+    // Returns an error message, or an empty string if the trace can be replayed
+    string open(const string& file) {
+        path = file;
+        in.open(path, ios::binary);
+        if (!in)
+            return "Could not open " + path;
+        TraceHeader expected;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != expected.magic)
+            return path + " is not a trace file";
+        if (header.version != expected.version)
+            return path + " has trace version " + to_string(header.version);
+        return "";
+    }
+
+    bool branch() {
+        return get() != 0;
+    }
+
+    int address() {
+        lastAddress += unzigzag(get());
+        return lastAddress;
+    }
+
+    int target() {
+        return unzigzag(get());
+    }
+};
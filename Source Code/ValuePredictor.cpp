@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Last-value/stride load value predictor
+// The table keeps, per load pc, the last committed value, the stride between the last two and
+// a 2-bit confidence counter; it is trained at commit, so in program order. A lookup at issue
+// predicts last + (inFlight + 1) * stride, where inFlight counts the instances of the load
+// issued but not committed yet, once the stride has repeated threshold times in a row. After a
+// squash the pipeline recounts inFlight from the loads left in the ROB.
+class ValuePredictor {
+    struct Entry {
+        int pc = -1;
+        int16_t last = 0;
+        int16_t stride = 0;
+        int confidence = 0;
+        int inFlight = 0;
+    };
+
+    vector<Entry> table;
+    int threshold;
+
+public:
+    long long lookups = 0;          // loads issued
+    long long predictions = 0;      // loads issued with a predicted value
+    long long correct = 0;          // predictions found right when the load wrote back
+    long long wrong = 0;            // predictions found wrong, each a squash of the younger instructions
+    long long squashed = 0;         // instructions squashed for them
+
+    ValuePredictor(int entries = 64, int confidenceThreshold = 2)
+        : table(entries), threshold(confidenceThreshold) {
+    }
+
+    bool predict(int pc, int16_t& value) {
+        lookups++;
+        Entry& e = table[pc % table.size()];
+        if (e.pc != pc)
+            return false;
+        e.inFlight++;
+        if (e.confidence < threshold)
+            return false;
+        value = (int16_t)(e.last + e.inFlight * e.stride);
+        predictions++;
+        return true;
+    }
+
+    bool tracks(int pc) const {
+        return table[pc % table.size()].pc == pc;
+    }
+
+    // younger: instances of the load still in flight behind this one, only used when the
+    // entry is allocated (before that predict() could not count them)
+    void train(int pc, int16_t value, int younger = 0) {
+        Entry& e = table[pc % table.size()];
+        if (e.pc != pc) {
+            e = Entry();
+            e.pc = pc;
+            e.last = value;
+            e.inFlight = younger;
+            return;
+        }
+        int16_t stride = (int16_t)(value - e.last);
+        if (stride == e.stride) {
+            if (e.confidence < 3)
+                e.confidence++;
+        }
+        else {
+            e.stride = stride;
+            e.confidence = 0;
+        }
+        e.last = value;
+        if (e.inFlight > 0)
+            e.inFlight--;
+    }
+
+    void clearInFlight() {
+        for (auto& e : table)
+            e.inFlight = 0;
+    }
+
+    void addInFlight(int pc) {
+        Entry& e = table[pc % table.size()];
+        if (e.pc == pc)
+            e.inFlight++;
+    }
+};
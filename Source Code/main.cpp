@@ -1,5 +1,15 @@
 ﻿
 #include "ROB.cpp"
+#include "StoreSet.cpp"
+#include "FrontEnd.cpp"
+#include "IntervalStats.cpp"
+#include "Memory.cpp"
+#include "Energy.cpp"
+#include "Prefetcher.cpp"
+#include "Trace.cpp"
+#include "CriticalPath.cpp"
+#include "ValuePredictor.cpp"
+#include "ResultCache.cpp"
 //#include <string>
 //#include <vector>
 //#include <iostream>
@@ -10,22 +20,41 @@
 //#include <limits>
 //#include <cctype>
 //using namespace std;
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <functional>
+#include <chrono>
+#include <iomanip>
 
 
 // Global Constants and Types
 
 const int NUM_REGS = 8;
-const int MEMORY_SIZE = 65536;  // 128 KB word-addressable
+const int MEMORY_SIZE = 65536;               // instruction addresses (pcStart) wrap at 64K words
+const int NOT_A_STORE = INT32_MIN;           // stores[] address of an entry that is not a store
+const int ADDRESS_UNKNOWN = INT32_MIN + 1;   // stores[] address of a store whose address is not computed yet
 
 // Station Constants
+// The core's sizes and latencies are thread_local so that the design-space search can run
+// differently configured cores side by side; other threads get them through applyConfig().
 
-int reserve_num[] = { 2, 1, 2, 1, 4, 2, 1 };
-int reserve_start[7];
-int cycles_num[] = { 2,2,1,1,2,1,12 };
+thread_local int reserve_num[] = { 2, 1, 2, 1, 4, 2, 1 };
+thread_local int reserve_start[7];
+thread_local int cycles_num[] = { 2,2,1,1,2,1,12 };
+const char* unitNames[7] = { "load", "store", "beq", "call/ret", "add/sub", "nand", "mul" };
 int ReadMemoryTime = 4;
 int WriteMemoryTime = 4;
-int TotalReserveStations = 13;
-int ROBSize = 8;
+thread_local int TotalReserveStations = 13;
+thread_local int ROBSize = 8;
 
 struct Instruction {
     char opcode;
@@ -43,39 +72,267 @@ struct RSEntry {
     int Qj, Qk;
     int robIndex;
     int executionCyclesLeft;
-    int16_t address;    // for load/store
+    int address;        // offset for load/store, target for branch/call
     int instId;             // just for recording purposes
 
     RSEntry():
         busy(false) {}
     
-    RSEntry(bool b, char o, int16_t vj, int16_t vk, int qj, int qk, int rind, int excl, int16_t add, int instid) : busy(b),
+    RSEntry(bool b, char o, int16_t vj, int16_t vk, int qj, int qk, int rind, int excl, int add, int instid) : busy(b),
         op(o), Vj(vj), Vk(vk), Qj(qj), Qk(qk), robIndex(rind), executionCyclesLeft(excl), address(add), instId(instid) {
     }
 };
 
 
-// Global Simulator State
+// Timing record of one dynamic instruction, filled in stage by stage; a fixed array so
+// that recording an instruction does not allocate
+struct InstRecord {
+    int times[6];
+    int n;
+
+    InstRecord(int pc, int issue) : n(2) {
+        times[0] = pc;
+        times[1] = issue;
+    }
+
+    int size() const { return n; }
+    int operator[](int i) const { return times[i]; }
+    void push_back(int t) {
+        if (n < 6)
+            times[n++] = t;
+    }
+};
 
-vector<Instruction> programMemory;         // Instructions
-int16_t dataMemory[MEMORY_SIZE];           // Data memory
-int16_t registers[NUM_REGS];               // Register file
-int regStatus[NUM_REGS];                   // ROB index producing reg (-1 if free)
-vector<vector<int>> records;                // 6 entries (pc, issue time, startExc, EndExec, write back, commit)
+
+// Global Simulator State
+// Everything a core owns is thread_local so that each host thread can run its own core
+// in multi-core mode; the data memory is the only state shared by all cores.
+
+PagedMemory dataMemory;                                  // Data memory, 32-bit word addresses (shared by all cores)
+thread_local PagedMemory* memoryImage = &dataMemory;     // memory this thread's core reads and writes
+thread_local vector<Instruction> programMemory;         // Instructions
+thread_local vector<string> programSource;              // source line of each instruction, for listings
+thread_local int16_t registers[NUM_REGS];               // Register file
+thread_local int regStatus[NUM_REGS];                   // ROB index producing reg (-1 if free)
+thread_local vector<InstRecord> records;                 // 6 entries (pc, issue time, startExc, EndExec, write back, commit)
 //vector<int> commitHistory;
-int branches = 0;
-int mispred = 0;
+thread_local int branches = 0;
+thread_local int mispred = 0;
+
+thread_local ROB rob(ROBSize);                           // Initializing Reorder buffer
+thread_local vector<RSEntry> reservationStations;        // All RS entries
+
+thread_local vector<vector<int>> stores(ROBSize);        // 3 values: address (NOT_A_STORE, ADDRESS_UNKNOWN), ready?, value         It's used to signify which datamemory items are about to be written to
+thread_local vector<vector<int>> loads(ROBSize);         // 3 values: read yet?, address, ROB index of the store it forwarded from (-1 for memory)
+
+
+thread_local int pc = 0;                                 // Program counter
+thread_local int pcStart = 0;
+thread_local int dynamicCount = 0;
+thread_local int cycle = 0;                              // Global cycle counter
+
+
+// Multi-core State
+
+int numCores = 1;
+int quantum = 100;                  // cycles each core runs before the cores synchronize
+int CoherenceMissTime = 8;          // extra cycles for a load whose copy was invalidated by another core
+
+struct CoreState {
+    vector<Instruction> program;
+    int pcStart = 0;
+    vector<pair<int, int16_t>> writes;  // stores committed during the current quantum, in order
+    unordered_set<int> cached;          // addresses this core holds a valid copy of
+    unordered_set<int> invalid;         // addresses invalidated by another core's write
+    long long invalidations = 0;
+    long long coherenceMisses = 0;
+    bool done = false;
+    string output;                      // printResults() of this core
+};
+
+vector<CoreState> cores;
+thread_local int coreId = 0;
+bool allCoresDone = false;
+
+
+// SMT State
+// The active hardware context lives in the globals above (programMemory, pc, pcStart, registers,
+// regStatus); the others are parked in contexts[] until switchContext() swaps them in.
+
+int smtThreads = 1;
+int fetchPolicy = 0;                // 0: round-robin, 1: ICOUNT
+bool robPartitioned = false;        // each context may hold at most ROBSize / smtThreads entries
+
+struct HWContext {
+    vector<Instruction> program;
+    int pc = 0;
+    int pcStart = 0;
+    int16_t registers[NUM_REGS] = {};
+    int regStatus[NUM_REGS] = {};
+    int committed = 0;
+    int branches = 0;
+    int mispred = 0;
+};
+
+thread_local vector<HWContext> contexts(1);
+thread_local int curThread = 0;
+thread_local int lastFetched = 0;
+thread_local vector<int> recordThread;      // context of each records entry
+
+
+// Memory Dependence Prediction
+
+bool useStoreSets = false;          // loads only wait for unresolved stores in their store set
+thread_local StoreSetPredictor storeSets;
+
+
+// Front End State
+// Without the front end, issue reads programMemory[pc] directly; with it, instructions go
+// through fetch (fetchWidth per cycle, I-cache) and a fetch/decode queue first.
+
+bool useFrontEnd = false;
+int fetchWidth = 2;
+int fetchQueueSize = 8;
+int frontEndDepth = 3;              // cycles from fetch until an instruction can be issued
+int ICacheLines = 16;
+int ICacheLineSize = 4;             // instructions per line
+int ICacheMissTime = 10;
+
+thread_local ICache icache;
+thread_local deque<FetchedInst> fetchQueue;
+thread_local int fetchPc = 0;
+thread_local int fetchStallUntil = 0;
+thread_local long long fetchedCount = 0;
+thread_local long long redirects = 0;
+thread_local long long starvedCycles = 0;   // cycles with nothing ready to issue
+
+
+// Debug Journal State
+
+bool useJournal = false;
+int journalInterval = 1000;         // cycles between full snapshots
+
+
+// Interval Statistics State
+
+bool useIntervalStats = false;
+int statsInterval = 1000;
+bool statsByCommits = false;        // sample every statsInterval committed instructions instead of cycles
+bool statsBinary = false;
+string statsPath = "stats.csv";
+
+// Running totals since the start of the current interval
+struct IntervalCounters {
+    int startCycle = 0;
+    long long committed = 0;
+    int startBranches = 0, startMispred = 0;
+    long long robSum = 0, rsSum = 0;
+    long long loadLatencySum = 0, loads = 0;
+};
+
+thread_local StatsStream statsStream;
+thread_local IntervalCounters interval;
+
+
+// Idiom Elimination State
+
+bool useIdiomElimination = false;
+thread_local long long eliminatedMoves = 0;
+thread_local long long eliminatedZeros = 0;
+thread_local long long eliminatedR0 = 0;
+thread_local vector<pair<int, int>> pendingMoves;  // RS index of the source's producer, ROB index of the move
+
+
+// Energy Model State
+// The pipeline always counts its events in energy (one array increment each); the estimate
+// is only computed and printed when useEnergy is set.
+
+bool useEnergy = false;
+EnergyParams energyParams;
+thread_local EnergyCounters energy;
+
+
+// Prefetcher State
+
+bool usePrefetcher = false;
+int prefetchTableSize = 16;
+int prefetchDistance = 2;           // strides ahead of the demand load
+int prefetchBufferSize = 8;
+int PrefetchHitTime = 1;
+thread_local StridePrefetcher prefetcher;
+
+
+// Value Prediction State
+// A confident prediction is handed to the load's dependents at issue, as if the load had
+// already written back; the load checks it when it does. Single context only.
+
+bool useValuePrediction = false;
+int valueTableSize = 64;
+int valueConfidence = 2;            // stride repeats needed before predicting (1 to 3)
+const int NO_PREDICTION = INT32_MIN;
+thread_local ValuePredictor valuePredictor;
+thread_local vector<int> predictedValue;        // by RS index: what the load's dependents were given, NO_PREDICTION for none
+long long predictionBaseline = -1;              // cycles of the same run without value prediction
+
+
+// Trace State
+// Recording writes the outcomes of the committed instructions to tracePath; replaying takes
+// them from there instead of from the operand values. Only the committed path has outcomes:
+// issue is on the wrong path from a taken BEQ, a CALL or a RET until the flush at its commit.
+
+enum TraceMode { TRACE_OFF, TRACE_RECORD, TRACE_REPLAY };
+int traceMode = TRACE_OFF;
+string tracePath;
+const int NO_OUTCOME = INT32_MIN;
+thread_local TraceWriter traceWriter;
+thread_local TraceReader traceReader;
+thread_local bool wrongPath = false;
+thread_local vector<int> replayOutcome;         // outcome of each ROB entry's instruction, NO_OUTCOME for none
+thread_local deque<int> replayInFlight;         // ROB entries with an outcome, oldest first
+thread_local deque<int> replayRewound;          // outcomes of squashed committed-path instructions, issued again first
+
+
+// Profile State
+// Totals per static instruction, added up as the run goes so they do not need the records table
+
+bool useProfile = false;
+
+struct PcProfile {
+    long long executed = 0;         // committed instances
+    long long latency = 0;          // sum of their issue-to-commit cycles
+    long long headCycles = 0;       // cycles it was the oldest instruction in the ROB
+    long long operandWait = 0;      // cycles its reservation stations waited on Qj/Qk
+    long long busWait = 0;          // cycles done but not granted the write-back bus
+    long long loadWait = 0;         // cycles a load waited in canLoad() for an older store
+    long long flushes = 0;          // pipeline flushes and load replays it caused
+};
+
+thread_local vector<PcProfile> profile;         // by instruction index
+thread_local vector<pair<int, int>> robIssue;   // pc and issue cycle of each ROB entry
+thread_local long long emptyRobCycles = 0;
+
+
+// Critical Path State
+
+bool useCriticalPath = false;
+thread_local vector<CriticalPathModel> pathModels;      // the run's configuration, its dataflow limit, then the what-ifs
+thread_local vector<string> pathModelNames;
 
-ROB rob(ROBSize);                           // Initializing Reorder buffer
-vector<RSEntry> reservationStations;        // All RS entries
 
-vector<vector<int>> stores(ROBSize);        // 3 values: address, ready?, value         It's used to signify which datamemory items are about to be written to
+// Result Cache State
 
+bool useResultCache = false;
+string cacheDir = "result-cache";
+int cacheMaxMB = 1024;
+ResultCache resultCache;
+string cacheIdentity;               // what the run's results depend on
+uint64_t cacheKey = 0;
 
-int pc = 0;                                 // Program counter
-int pcStart = 0;
-int dynamicCount = 0;
-int cycle = 0;                              // Global cycle counter
+
+// Design-Space Search State
+
+bool useSearch = false;             // search for a configuration instead of running one simulation
+bool useBatch = false;              // run the program functionally over many data sets instead
 
 
 // Phase 1: Initialization
@@ -123,6 +380,16 @@ vector<string> tokenize(const string& line) {
     return tokens;
 }
 
+void computeReserveStarts() {
+    int acc = 0;
+    for (int i = 0; i < 7; i++)
+    {
+        reserve_start[i] = acc;
+        acc += reserve_num[i];
+    }
+    TotalReserveStations = acc;
+}
+
 void loadProgram() {                            // load program to memory
     programMemory.clear();
 
@@ -193,11 +460,13 @@ void loadProgram() {                            // load program to memory
 
     // SECOND PASS: parse instructions into programMemory
     currentIndex = 0;
+    programSource.clear();
 
     for (string line : rawLines) {
         line = stripComment(line);
         trim(line);
         if (line.empty()) continue;
+        string source = line;
 
         // Remove label if present
         size_t colonPos = line.find(':');
@@ -380,6 +649,7 @@ void loadProgram() {                            // load program to memory
         }
 
         programMemory.push_back(inst);
+        programSource.push_back(source);
         currentIndex++;
     }
 
@@ -387,13 +657,7 @@ void loadProgram() {                            // load program to memory
     cin >> pcStart;
     pcStart = pcStart % MEMORY_SIZE;
 
-    int acc = 0;
-    for (int i = 0; i < 7; i++)
-    {
-        reserve_start[i] = acc;
-        acc += reserve_num[i];
-    }
-    TotalReserveStations = acc;
+    computeReserveStarts();
 }               
 
 void chooseVariables() {
@@ -439,34 +703,237 @@ void chooseVariables() {
     }
 }
 
+// Sizes and latencies of one core, for handing a configuration to another thread
+struct CoreConfig {
+    int robSize;
+    array<int, 7> reserveNum;
+    array<int, 7> cyclesNum;
+};
+
+CoreConfig currentConfig() {
+    CoreConfig c;
+    c.robSize = ROBSize;
+    copy(reserve_num, reserve_num + 7, c.reserveNum.begin());
+    copy(cycles_num, cycles_num + 7, c.cyclesNum.begin());
+    return c;
+}
+
+void applyConfig(const CoreConfig& c) {
+    ROBSize = c.robSize;
+    copy(c.reserveNum.begin(), c.reserveNum.end(), reserve_num);
+    copy(c.cyclesNum.begin(), c.cyclesNum.end(), cycles_num);
+    computeReserveStarts();
+}
+
+void chooseFeatures() {
+    cout << "Do you want to enable extra simulation features (multi-core, SMT, store sets, front end, debug journal, interval statistics, idiom elimination, energy, prefetcher, instruction traces, profile, critical path, value prediction, design-space search, batched execution, result cache)?\n";
+    cout << "If so, press 1, otherwise press 0\n";
+    int ans;
+    cin >> ans;
+    if (!ans)
+        return;
+    cout << "Enter the number of cores (1 for a single core): ";
+    cin >> numCores;
+    if (numCores < 1)
+        numCores = 1;
+    if (numCores > 1) {
+        cout << "Enter the number of cycles each core runs between synchronizations (quantum): ";
+        cin >> quantum;
+        if (quantum < 1)
+            quantum = 1;
+        cout << "Enter the number of extra cycles for a coherence miss: ";
+        cin >> CoherenceMissTime;
+    }
+    else {
+        cout << "Enter the number of SMT hardware contexts (1 for none): ";
+        cin >> smtThreads;
+        if (smtThreads < 1)
+            smtThreads = 1;
+        if (smtThreads > 1) {
+            cout << "Choose the fetch policy: 0) round-robin 1) ICOUNT\n";
+            cin >> fetchPolicy;
+            cout << "Do you want to partition the ROB between the contexts? press 1, otherwise press 0 to share it\n";
+            cin >> robPartitioned;
+        }
+    }
+    if (smtThreads == 1) {
+        cout << "Do you want loads to use the store-set predictor instead of waiting for every unresolved store? press 1, otherwise press 0\n";
+        cin >> useStoreSets;
+        cout << "Do you want to model the fetch front end (fetch queue and instruction cache)? press 1, otherwise press 0\n";
+        cin >> useFrontEnd;
+        if (useFrontEnd) {
+            cout << "Enter the fetch width (instructions per cycle): ";
+            cin >> fetchWidth;
+            cout << "Enter the fetch/decode queue size: ";
+            cin >> fetchQueueSize;
+            cout << "Enter the front-end depth (cycles from fetch to issue): ";
+            cin >> frontEndDepth;
+            cout << "Enter the number of instruction cache lines: ";
+            cin >> ICacheLines;
+            cout << "Enter the number of instructions per cache line: ";
+            cin >> ICacheLineSize;
+            cout << "Enter the number of cycles for an instruction cache miss: ";
+            cin >> ICacheMissTime;
+        }
+    }
+    if (numCores == 1 && smtThreads == 1) {
+        cout << "Do you want to record a debug journal to step backward and forward through the run? press 1, otherwise press 0\n";
+        cin >> useJournal;
+        if (useJournal) {
+            cout << "Enter the number of cycles between full snapshots: ";
+            cin >> journalInterval;
+            if (journalInterval < 1)
+                journalInterval = 1;
+        }
+    }
+    cout << "Do you want to stream interval statistics (IPC, misprediction rate, ROB/RS occupancy, load latency) to a file? press 1, otherwise press 0\n";
+    cin >> useIntervalStats;
+    if (useIntervalStats) {
+        cout << "Sample every N cycles (press 0) or every N committed instructions (press 1): ";
+        cin >> statsByCommits;
+        cout << "Enter N: ";
+        cin >> statsInterval;
+        if (statsInterval < 1)
+            statsInterval = 1;
+        cout << "Choose the output format: 0) CSV 1) binary\n";
+        cin >> statsBinary;
+        cout << "Enter the output file name";
+        if (numCores > 1)
+            cout << " (each core adds its number before the extension)";
+        cout << ": ";
+        cin >> statsPath;
+    }
+    cout << "Do you want to eliminate moves, zero idioms and writes to R0 at issue? press 1, otherwise press 0\n";
+    cin >> useIdiomElimination;
+    cout << "Do you want to estimate energy and power? press 1, otherwise press 0\n";
+    cin >> useEnergy;
+    if (useEnergy) {
+        cout << "Do you want to use the default energy per event and leakage? press 1, otherwise press 0 to enter them\n";
+        cin >> ans;
+        if (!ans) {
+            for (int e = 0; e < NUM_ENERGY_EVENTS; e++) {
+                cout << "Enter the energy of a " << EnergyParams::name(e) << " (pJ): ";
+                cin >> energyParams.event[e];
+            }
+            cout << "Enter the leakage per cycle outside the ROB and the reservation stations (pJ): ";
+            cin >> energyParams.baseLeakage;
+            cout << "Enter the leakage per ROB entry per cycle (pJ): ";
+            cin >> energyParams.robEntryLeakage;
+            cout << "Enter the leakage per reservation station per cycle (pJ): ";
+            cin >> energyParams.rsEntryLeakage;
+            cout << "Enter the clock frequency (GHz): ";
+            cin >> energyParams.clockGHz;
+        }
+    }
+    cout << "Do you want a stride prefetcher for loads? press 1, otherwise press 0\n";
+    cin >> usePrefetcher;
+    if (usePrefetcher) {
+        cout << "Enter the number of entries in the reference prediction table: ";
+        cin >> prefetchTableSize;
+        if (prefetchTableSize < 1)
+            prefetchTableSize = 1;
+        cout << "Enter the prefetch distance (strides ahead of the demand load): ";
+        cin >> prefetchDistance;
+        cout << "Enter the number of entries in the prefetch buffer: ";
+        cin >> prefetchBufferSize;
+        if (prefetchBufferSize < 1)
+            prefetchBufferSize = 1;
+        cout << "Enter the number of cycles for a load that hits a completed prefetch: ";
+        cin >> PrefetchHitTime;
+    }
+    if (numCores == 1 && smtThreads == 1) {
+        cout << "Do you want to record the committed instruction stream to a trace file (press 1), replay a recorded trace instead of computing the outcomes (press 2), or neither (press 0)?\n";
+        cin >> traceMode;
+        if (traceMode != TRACE_OFF) {
+            cout << "Enter the trace file name: ";
+            cin >> tracePath;
+        }
+        cout << "Do you want a per-instruction profile of latencies and stalls (annotated program listing)? press 1, otherwise press 0\n";
+        cin >> useProfile;
+        cout << "Do you want a critical-path analysis with what-if estimates for the sizes and latencies? press 1, otherwise press 0\n";
+        cin >> useCriticalPath;
+        if (traceMode != TRACE_REPLAY) {
+            cout << "Do you want a last-value/stride predictor to supply load values to dependents early? press 1, otherwise press 0\n";
+            cin >> useValuePrediction;
+        }
+        if (useValuePrediction) {
+            cout << "Enter the number of entries in the value prediction table: ";
+            cin >> valueTableSize;
+            if (valueTableSize < 1)
+                valueTableSize = 1;
+            cout << "Enter the number of times a stride must repeat before it is used (1 to 3): ";
+            cin >> valueConfidence;
+            valueConfidence = max(1, min(valueConfidence, 3));
+        }
+    }
+    if (numCores == 1 && smtThreads == 1 && !useJournal && !useIntervalStats && traceMode == TRACE_OFF && !useProfile && !useCriticalPath) {
+        cout << "Do you want to search for the cheapest configuration that meets a performance target instead of running one simulation? press 1, otherwise press 0\n";
+        cin >> useSearch;
+    }
+    if (numCores == 1 && smtThreads == 1 && !useJournal && !useIntervalStats && traceMode == TRACE_OFF && !useProfile && !useCriticalPath && !useValuePrediction && !useSearch) {
+        cout << "Do you want to run the program over many input data sets at once (batched functional execution)? press 1, otherwise press 0\n";
+        cin >> useBatch;
+    }
+    if (numCores == 1 && smtThreads == 1 && !useJournal && !useIntervalStats && traceMode != TRACE_REPLAY && !useSearch && !useBatch) {
+        cout << "Do you want to keep the results in an on-disk cache and reuse them for identical runs? press 1, otherwise press 0\n";
+        cin >> useResultCache;
+        if (useResultCache) {
+            cout << "Enter the cache directory: ";
+            cin >> cacheDir;
+            cout << "Enter the maximum size of the cache (MB): ";
+            cin >> cacheMaxMB;
+        }
+    }
+}
+
+void loadThreads() {                          // one program per SMT context
+    contexts.resize(smtThreads);
+    for (int t = 0; t < smtThreads; t++) {
+        cout << "Program for hardware context " << t << ":\n";
+        loadProgram();
+        contexts[t].program = programMemory;
+        contexts[t].pcStart = pcStart;
+    }
+    swap(programMemory, contexts[0].program);
+    pcStart = contexts[0].pcStart;
+    curThread = 0;
+}
+
 void initRegisters() {                        // Initialize registers and regStatus
     registers[0] = 0;
     for (int i = 0; i < NUM_REGS; i++) {
         registers[i] = 0;
         regStatus[i] = -1;
     }
+    for (auto& ctx : contexts)
+        fill(ctx.regStatus, ctx.regStatus + NUM_REGS, -1);
 }
 
 void initMemory() {                           // Initialize dataMemory
     cout << "Do you need to enter data into the data memory?\nIf so press 1, else press 0.\n";
     int ans;
-    int16_t address, data;
+    int address;
+    int16_t data;
     cin >> ans;
     while (ans) {
         cout << "Enter the address you want to enter data to: ";
         cin >> address;
         cout << "Enter the data you want to enter at address " << address << ": ";
         cin >> data;
-        dataMemory[address] = data;
+        memoryImage->write(address, data);
         cout << "\nDo you want to enter more data?\nIf yes, press 1, else press 0\n";
         cin >> ans;
     }
     cout << "\nThe program will start running now.\n";
-    for (int i = 0; i < ROBSize; i++)
-        stores[i] = { -1,0,0 };
 }
 
-void initReservationStations() {              // Initialize all RS entries
+void initReservationStations() {              // Initialize all RS entries, the ROB, the store buffer and the prefetcher
+    rob = ROB(ROBSize);
+    stores.assign(ROBSize, { NOT_A_STORE,0,0 });
+    loads.assign(ROBSize, { 0,0,-1 });
+    prefetcher = StridePrefetcher(prefetchTableSize, prefetchDistance, prefetchBufferSize, PrefetchHitTime);
+    valuePredictor = ValuePredictor(valueTableSize, valueConfidence);
+    predictedValue.assign(TotalReserveStations, NO_PREDICTION);
     reservationStations.resize(TotalReserveStations);
     for (auto &rs : reservationStations)
         rs.busy = false;
@@ -475,6 +942,7 @@ void initReservationStations() {              // Initialize all RS entries
 
 int recordIssue(int instID) {
     records.push_back({ instID,cycle });
+    recordThread.push_back(curThread);
     return records.size() - 1;
 }
 
@@ -497,11 +965,477 @@ void recordCommit(int instId) {
 }
 
 
+// Debug journal
+// Records what changed in every cycle (RS entries, ROB entries and pointers, regStatus,
+// registers and data memory writes) plus a full snapshot every journalInterval cycles.
+// Any cycle is rebuilt from the snapshot before it and at most journalInterval deltas,
+// so the debugger can step backward and forward and jump anywhere after the run. Memory writes
+// are only kept to show the ones of each cycle; the snapshots do not copy the memory.
+
+enum JournalKind : char { J_REG, J_REGSTATUS, J_MEM };
+
+struct JournalItem {
+    JournalKind kind;
+    int index;          // register number or memory address
+    int value;
+};
+
+struct CycleDelta {
+    int pc, dynamicCount, branches, mispred;
+    int robHead, robTail, robCount;
+    unsigned firstItem, firstRS, firstROB;      // where this cycle's changes start in the pools
+};
+
+struct JournalState {
+    int cycle = 0;
+    int pc = 0, dynamicCount = 0, branches = 0, mispred = 0;
+    int robHead = 0, robTail = 0, robCount = 0;
+    vector<RSEntry> rs;
+    vector<ROBEntry> rob;
+    int16_t registers[NUM_REGS] = {};
+    int regStatus[NUM_REGS] = {};
+};
+
+class DebugJournal {
+    vector<CycleDelta> deltas;                  // deltas[c - 1] turns the state after c - 1 cycles into the state after c
+    vector<JournalItem> items;
+    vector<pair<int, RSEntry>> rsPool;
+    vector<pair<int, ROBEntry>> robPool;
+    vector<JournalState> snapshots;             // snapshots[k] is the state after k * journalInterval cycles
+    JournalState shadow;                        // state after the last recorded cycle
+    vector<JournalItem> pendingMem;             // memory writes of the cycle being simulated
+
+    static bool sameRS(const RSEntry& a, const RSEntry& b) {
+        if (!a.busy && !b.busy)
+            return true;
+        return a.busy == b.busy && a.op == b.op && a.Vj == b.Vj && a.Vk == b.Vk && a.Qj == b.Qj && a.Qk == b.Qk
+            && a.robIndex == b.robIndex && a.executionCyclesLeft == b.executionCyclesLeft && a.address == b.address;
+    }
+
+    static bool sameROB(const ROBEntry& a, const ROBEntry& b) {
+        return a.busy == b.busy && a.type == b.type && a.destination == b.destination && a.value == b.value
+            && a.ready == b.ready && a.instId == b.instId;
+    }
+
+    void apply(JournalState& st, const CycleDelta& d, unsigned itemEnd, unsigned rsEnd, unsigned robEnd) const {
+        st.pc = d.pc;
+        st.dynamicCount = d.dynamicCount;
+        st.branches = d.branches;
+        st.mispred = d.mispred;
+        st.robHead = d.robHead;
+        st.robTail = d.robTail;
+        st.robCount = d.robCount;
+        for (unsigned i = d.firstItem; i < itemEnd; i++) {
+            const JournalItem& it = items[i];
+            if (it.kind == J_REG)
+                st.registers[it.index] = it.value;
+            else if (it.kind == J_REGSTATUS)
+                st.regStatus[it.index] = it.value;
+        }
+        for (unsigned i = d.firstRS; i < rsEnd; i++)
+            st.rs[rsPool[i].first] = rsPool[i].second;
+        for (unsigned i = d.firstROB; i < robEnd; i++)
+            st.rob[robPool[i].first] = robPool[i].second;
+        st.cycle++;
+    }
+
+public:
+    void memoryWrite(int address, int16_t value) {
+        pendingMem.push_back({ J_MEM, address, value });
+    }
+
+    void start() {
+        shadow = JournalState();
+        shadow.pc = pc;
+        shadow.rs = reservationStations;
+        for (int i = 0; i < rob.getSize(); i++)
+            shadow.rob.push_back(rob.entryAt(i));
+        copy(registers, registers + NUM_REGS, shadow.registers);
+        copy(regStatus, regStatus + NUM_REGS, shadow.regStatus);
+        snapshots.push_back(shadow);
+    }
+
+    // Called at the end of every cycle
+    void record() {
+        CycleDelta d;
+        d.pc = pc;
+        d.dynamicCount = dynamicCount;
+        d.branches = branches;
+        d.mispred = mispred;
+        d.robHead = rob.getHead();
+        d.robTail = rob.getTail();
+        d.robCount = rob.getCount();
+        d.firstItem = items.size();
+        d.firstRS = rsPool.size();
+        d.firstROB = robPool.size();
+
+        for (int r = 0; r < NUM_REGS; r++) {
+            if (registers[r] != shadow.registers[r])
+                items.push_back({ J_REG, r, registers[r] });
+            if (regStatus[r] != shadow.regStatus[r])
+                items.push_back({ J_REGSTATUS, r, regStatus[r] });
+        }
+        items.insert(items.end(), pendingMem.begin(), pendingMem.end());
+        pendingMem.clear();
+        for (int i = 0; i < (int)reservationStations.size(); i++)
+            if (!sameRS(reservationStations[i], shadow.rs[i]))
+                rsPool.push_back({ i, reservationStations[i] });
+        for (int i = 0; i < rob.getSize(); i++)
+            if (!sameROB(rob.entryAt(i), shadow.rob[i]))
+                robPool.push_back({ i, rob.entryAt(i) });
+
+        deltas.push_back(d);
+        apply(shadow, d, items.size(), rsPool.size(), robPool.size());
+        if (shadow.cycle % journalInterval == 0)
+            snapshots.push_back(shadow);
+    }
+
+    int cycles() const {
+        return deltas.size();
+    }
+
+    // State after c cycles: the snapshot before it plus the deltas in between
+    JournalState stateAt(int c) const {
+        JournalState st = snapshots[c / journalInterval];
+        while (st.cycle < c) {
+            const CycleDelta& d = deltas[st.cycle];
+            bool last = st.cycle + 1 == (int)deltas.size();
+            unsigned itemEnd = last ? items.size() : deltas[st.cycle + 1].firstItem;
+            unsigned rsEnd = last ? rsPool.size() : deltas[st.cycle + 1].firstRS;
+            unsigned robEnd = last ? robPool.size() : deltas[st.cycle + 1].firstROB;
+            apply(st, d, itemEnd, rsEnd, robEnd);
+        }
+        return st;
+    }
+
+    // Memory writes made during cycle c (the one that ends with the state after c + 1 cycles)
+    vector<JournalItem> memoryWritesOf(int c) const {
+        vector<JournalItem> writes;
+        unsigned end = c + 1 == (int)deltas.size() ? items.size() : deltas[c + 1].firstItem;
+        for (unsigned i = deltas[c].firstItem; i < end; i++)
+            if (items[i].kind == J_MEM)
+                writes.push_back(items[i]);
+        return writes;
+    }
+};
+
+thread_local DebugJournal journal;
+
+void printJournalState(int c) {
+    JournalState st = journal.stateAt(c);
+    cout << "\n--- After cycle " << c - 1 << " (" << c << " of " << journal.cycles() << " cycles simulated) ---\n";
+    cout << "pc: " << st.pc + pcStart << ", issued: " << st.dynamicCount << ", branches: " << st.branches
+        << ", mispredicted: " << st.mispred << "\n";
+    cout << "Registers:";
+    for (int r = 0; r < NUM_REGS; r++)
+        cout << " R" << r << "=" << st.registers[r];
+    cout << "\nregStatus:";
+    for (int r = 0; r < NUM_REGS; r++)
+        cout << " R" << r << "=" << st.regStatus[r];
+    cout << "\nROB (head " << st.robHead << ", tail " << st.robTail << ", " << st.robCount << " entries):\n";
+    for (int n = 0, i = st.robHead; n < st.robCount; n++, i = (i + 1) % st.rob.size()) {
+        const ROBEntry& e = st.rob[i];
+        cout << "  [" << i << "] " << e.type << " pc " << records[e.instId][0] + pcStart << " dest " << e.destination
+            << (e.ready ? " ready, value " : " waiting") << (e.ready ? to_string(e.value) : "") << "\n";
+    }
+    cout << "Reservation stations:\n";
+    for (int i = 0; i < (int)st.rs.size(); i++) {
+        const RSEntry& e = st.rs[i];
+        if (!e.busy)
+            continue;
+        cout << "  [" << i << "] " << e.op << " Vj " << e.Vj << " Vk " << e.Vk << " Qj " << e.Qj << " Qk " << e.Qk
+            << " ROB " << e.robIndex << " cycles left " << e.executionCyclesLeft << "\n";
+    }
+    if (c > 0)
+        for (const JournalItem& w : journal.memoryWritesOf(c - 1))
+            cout << "Memory write: M[" << w.index << "] = " << w.value << "\n";
+}
+
+void runDebugger() {
+    int c = journal.cycles();
+    cout << "\nDebug journal: " << c << " cycles recorded.\n";
+    cout << "Commands: n (next cycle), p (previous cycle), g <cycle> (go to the state after that cycle), q (quit)\n";
+    printJournalState(c);
+    string cmd;
+    while (cin >> cmd && cmd != "q") {
+        if (cmd == "n")
+            c = min(c + 1, journal.cycles());
+        else if (cmd == "p")
+            c = max(c - 1, 0);
+        else if (cmd == "g") {
+            int target;
+            cin >> target;
+            c = max(0, min(target + 1, journal.cycles()));
+        }
+        else {
+            cout << "Unknown command\n";
+            continue;
+        }
+        printJournalState(c);
+    }
+}
+
+
+// Data memory access
+// With several cores, a core's stores stay in its write buffer until the end of the quantum,
+// when they are applied to the shared memory in core order (see endQuantum()).
+
+// coherenceMiss is set when another core invalidated our copy of the address
+int loadLatency(int address, bool& coherenceMiss) {
+    coherenceMiss = false;
+    if (numCores == 1)
+        return ReadMemoryTime;
+    CoreState& core = cores[coreId];
+    core.cached.insert(address);
+    if (core.invalid.erase(address)) {      // our copy was invalidated by another core
+        core.coherenceMisses++;
+        coherenceMiss = true;
+        return ReadMemoryTime + CoherenceMissTime;
+    }
+    return ReadMemoryTime;
+}
+
+int16_t readMemory(int address) {
+    energy.count(EV_MEM_READ);
+    if (numCores > 1) {
+        vector<pair<int, int16_t>>& writes = cores[coreId].writes;
+        for (int i = writes.size() - 1; i >= 0; i--)
+            if (writes[i].first == address)
+                return writes[i].second;
+    }
+    return memoryImage->read(address);
+}
+
+void writeMemory(int address, int16_t value) {
+    energy.count(EV_MEM_WRITE);
+    if (useJournal)
+        journal.memoryWrite(address, value);
+    if (numCores == 1) {
+        memoryImage->write(address, value);
+        return;
+    }
+    cores[coreId].writes.push_back({ address, value });
+    cores[coreId].cached.insert(address);
+    cores[coreId].invalid.erase(address);
+}
+
+
+// SMT context switching
+
+void switchContext(int t) {
+    if (t == curThread)
+        return;
+    HWContext& old = contexts[curThread];
+    swap(old.program, programMemory);
+    old.pc = pc;
+    old.pcStart = pcStart;
+    copy(registers, registers + NUM_REGS, old.registers);
+    copy(regStatus, regStatus + NUM_REGS, old.regStatus);
+
+    HWContext& now = contexts[t];
+    swap(now.program, programMemory);
+    pc = now.pc;
+    pcStart = now.pcStart;
+    copy(now.registers, now.registers + NUM_REGS, registers);
+    copy(now.regStatus, now.regStatus + NUM_REGS, regStatus);
+    curThread = t;
+}
+
+bool threadFetching(int t) {                // context still has instructions to issue
+    if (t == curThread)
+        return pc < (int)programMemory.size();
+    return contexts[t].pc < (int)contexts[t].program.size();
+}
+
+int threadPcStart(int t) {
+    return t == curThread ? pcStart : contexts[t].pcStart;
+}
+
+
+// Instruction traces
+// A recorded run writes one outcome per committed BEQ, load, store and RET (see Trace.cpp).
+// A replayed run hands them out in program order as the committed path issues, keeps them
+// with the ROB entries until commit, and gives them back when a load replay squashes their
+// instructions. The values still flow through the pipeline, but nothing the timing depends
+// on is taken from them on the committed path, so the data memory does not need to be set up.
+
+uint64_t programHash() {
+    uint64_t hash = 14695981039346656037ull;
+    for (const Instruction& inst : programMemory)
+        for (int field : { (int)inst.opcode, inst.dst, inst.src1, inst.src2, (int)inst.imm })
+            hash = (hash ^ (uint32_t)field) * 1099511628211ull;
+    return hash;
+}
+
+bool startTrace() {
+    if (traceMode == TRACE_RECORD) {
+        if (!traceWriter.open(tracePath, pcStart, programHash()))
+            cout << "Could not open " << tracePath << ", no trace will be written\n";
+        return true;
+    }
+    string error = traceReader.open(tracePath);
+    if (error.empty() && (traceReader.header.programHash != programHash() || traceReader.header.pcStart != pcStart))
+        error = tracePath + " was recorded from a different program";
+    if (!error.empty()) {
+        cout << error << "\n";
+        return false;
+    }
+    replayOutcome.assign(ROBSize, NO_OUTCOME);
+    return true;
+}
+
+// The outcome of rs's instruction from the trace if it has one, otherwise the computed one
+int replayed(const RSEntry& rs, int computed) {
+    if (traceMode != TRACE_REPLAY || replayOutcome[rs.robIndex] == NO_OUTCOME)
+        return computed;
+    return replayOutcome[rs.robIndex];
+}
+
+void replayIssue(const Instruction& inst, int robIndex) {
+    replayOutcome[robIndex] = NO_OUTCOME;
+    if (wrongPath)
+        return;
+    int outcome;
+    if (inst.opcode != 'l' && inst.opcode != 't' && inst.opcode != 'b' && inst.opcode != 'r') {
+        wrongPath = inst.opcode == 'c';
+        return;
+    }
+    if (!replayRewound.empty()) {
+        outcome = replayRewound.front();
+        replayRewound.pop_front();
+    }
+    else if (inst.opcode == 'b')
+        outcome = traceReader.branch();
+    else if (inst.opcode == 'r')
+        outcome = traceReader.target();
+    else
+        outcome = traceReader.address();
+    replayOutcome[robIndex] = outcome;
+    replayInFlight.push_back(robIndex);
+    wrongPath = inst.opcode == 'r' || (inst.opcode == 'b' && outcome);
+}
+
+// loadRob and everything younger were squashed and will issue again
+void rewindReplay(int loadRob) {
+    while (!replayInFlight.empty() && !rob.isBusy(replayInFlight.back())) {
+        replayRewound.push_front(replayOutcome[replayInFlight.back()]);
+        replayInFlight.pop_back();
+    }
+    wrongPath = replayOutcome[loadRob] == NO_OUTCOME;
+}
+
+void traceCommit(int robIndex, char op, int dest, int value) {
+    if (traceMode == TRACE_REPLAY) {
+        if (replayOutcome[robIndex] != NO_OUTCOME)
+            replayInFlight.pop_front();
+        return;
+    }
+    if (!traceWriter.isOpen())
+        return;
+    traceWriter.committed();
+    switch (op) {
+    case 'l':
+        traceWriter.address(loads[robIndex][1]);
+        break;
+    case 't':
+        traceWriter.address(dest);
+        break;
+    case 'b':
+        traceWriter.branch(value);
+        break;
+    case 'r':
+        traceWriter.target(dest);
+        break;
+    }
+}
+
+
+// Per-instruction profile
+// Every cycle is charged to the oldest instruction in the ROB (the one commit is waiting for),
+// or to the empty ROB, so the cycles of the listing add up to the length of the run. The other
+// columns say why: operand waits, write-back bus conflicts, loads held back by older stores,
+// and the flushes an instruction caused. The waits count squashed wrong-path instances too.
+
+void startProfile() {
+    profile.assign(programMemory.size(), PcProfile());
+    robIssue.assign(ROBSize, { 0, 0 });
+    emptyRobCycles = 0;
+}
+
+PcProfile& profileOf(int robIndex) {
+    return profile[robIssue[robIndex].first];
+}
+
+void profileCommit(int robIndex) {
+    PcProfile& p = profileOf(robIndex);
+    p.executed++;
+    p.latency += cycle - robIssue[robIndex].second;
+}
+
+// Called at the start of every cycle
+void profileCycle() {
+    if (rob.isEmpty())
+        emptyRobCycles++;
+    else
+        profileOf(rob.getHead()).headCycles++;
+}
+
+void printProfile(ostream& out) {
+    vector<int> order(profile.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [](int a, int b) {
+        return profile[a].headCycles > profile[b].headCycles;
+    });
+    long long total = emptyRobCycles;
+    for (auto& p : profile)
+        total += p.headCycles;
+    out << "     cycles   % run   executed  avg latency  operand wait  bus wait  load wait  flushes  instruction\n";
+    out << fixed << setprecision(1);
+    for (int i : order) {
+        const PcProfile& p = profile[i];
+        out << "   " << setw(8) << p.headCycles << "  " << setw(6) << (total > 0 ? 100.0 * p.headCycles / total : 0.0)
+            << "  " << setw(9) << p.executed << "  " << setw(11) << (p.executed > 0 ? static_cast<double>(p.latency) / p.executed : 0.0)
+            << "  " << setw(12) << p.operandWait << "  " << setw(8) << p.busWait << "  " << setw(9) << p.loadWait
+            << "  " << setw(7) << p.flushes << "  " << i + pcStart << ": " << (i < (int)programSource.size() ? programSource[i] : "") << "\n";
+    }
+    out << "   " << setw(8) << emptyRobCycles << "  " << setw(6) << (total > 0 ? 100.0 * emptyRobCycles / total : 0.0)
+        << "  (empty ROB)\n";
+    out << defaultfloat << setprecision(6);
+}
+
+
+// Load value prediction
+// A load looks its pc up at issue. The instructions issued while it is in flight that wait on
+// it take the predicted value instead, so they can execute before the load's value arrives. When
+// the load writes back its value is compared with the prediction; on a mismatch everything
+// younger may have used the wrong value, so it is squashed and issue restarts after the load.
+
+void predictLoad(int station) {
+    int16_t value;
+    predictedValue[station] = valuePredictor.predict(pc, value) ? value : NO_PREDICTION;
+}
+
+// Gives an instruction being issued the predicted values of the loads it waits on
+void usePredictedValues(RSEntry& rs) {
+    if (rs.Qj >= 0 && reservationStations[rs.Qj].busy && reservationStations[rs.Qj].op == 'l' && predictedValue[rs.Qj] != NO_PREDICTION) {
+        rs.Vj = predictedValue[rs.Qj];
+        rs.Qj = -1;
+    }
+    if (rs.op != 'l' && rs.Qk >= 0 && reservationStations[rs.Qk].busy && reservationStations[rs.Qk].op == 'l' && predictedValue[rs.Qk] != NO_PREDICTION) {
+        rs.Vk = predictedValue[rs.Qk];
+        rs.Qk = -1;
+    }
+}
+
+
 // Phase 2: Issue
 
 bool canIssue(const Instruction& inst, int& i) {
     if (rob.isFull())
         return false;
+    if (robPartitioned && rob.countOf(curThread) >= ROBSize / smtThreads)
+        return false;
     switch (inst.opcode) {
     case 'l':
         i = reserve_start[0];
@@ -597,27 +1531,137 @@ bool canIssue(const Instruction& inst, int& i) {
     return false;
 }
 
-void issueInstruction(const Instruction& inst) {
-    int ind;
-    if (!canIssue(inst, ind)) {
-        //pc++;
-        return;
-    }
+// Idiom elimination
+// Writes to R0, zero idioms (SUB Rx,Ry,Ry and ADD Rx,R0,R0) and moves (ADD Rx,Ry,R0, ADD Rx,R0,Ry,
+// SUB Rx,Ry,R0) get a ROB entry at issue but no reservation station, and never use the write-back
+// bus. They are recorded as executed and written back in the cycle they become ready: at issue,
+// or for a move whose source is still being computed, when that source's producer writes back.
+// Until then the move's destination waits on the same producer as its source.
+
+enum IdiomKind { NO_IDIOM, MOVE_IDIOM, ZERO_IDIOM, R0_WRITE };
+
+IdiomKind idiomOf(const Instruction& inst) {
+    if (!ROB::writesRegister(inst.opcode))
+        return NO_IDIOM;
+    if (inst.dst == 0)
+        return R0_WRITE;
+    if ((inst.opcode == 's' && inst.src1 == inst.src2) || (inst.opcode == 'a' && inst.src1 == 0 && inst.src2 == 0))
+        return ZERO_IDIOM;
+    if ((inst.opcode == 'a' && (inst.src1 == 0 || inst.src2 == 0)) || (inst.opcode == 's' && inst.src2 == 0))
+        return MOVE_IDIOM;
+    return NO_IDIOM;
+}
+
+bool eliminateInstruction(const Instruction& inst, IdiomKind kind) {
+    if (rob.isFull())
+        return false;
+    if (robPartitioned && rob.countOf(curThread) >= ROBSize / smtThreads)
+        return false;
     int j = recordIssue(pc);
-    int rbInd = rob.allocate(inst.opcode, inst.dst, j);
-    int16_t val1 = -1, val2 = -1;
-    if (inst.src1 >= 0 && !rob.findVal(inst.src1, val1))
-        val1 = registers[inst.src1];
-    if (inst.src2 >= 0 && !rob.findVal(inst.src2, val2))
-        val2 = registers[inst.src2];
-    switch (inst.opcode) {
-    case 'l':
-        reservationStations[ind] = RSEntry(true, inst.opcode, val1, val2, regStatus[inst.src1], -1, rbInd, cycles_num[0], inst.imm, j);
-        regStatus[inst.dst] = ind;
+    int rbInd = rob.allocate(inst.opcode, inst.dst, j, curThread);
+    stores[rbInd] = { NOT_A_STORE,0,0 };
+    loads[rbInd] = { 0,0,-1 };
+    if (traceMode == TRACE_REPLAY)
+        replayIssue(inst, rbInd);
+    if (useProfile)
+        robIssue[rbInd] = { pc, cycle };
+    energy.count(EV_ISSUE);
+    energy.count(EV_ROB_WRITE);
+    int src = inst.src1 == 0 ? inst.src2 : inst.src1;
+    if (kind == MOVE_IDIOM && regStatus[src] != -1) {
+        regStatus[inst.dst] = regStatus[src];
+        pendingMoves.push_back({ regStatus[src], rbInd });
+    }
+    else {
+        int16_t value = 0;
+        if (kind == MOVE_IDIOM)
+            energy.count(EV_ROB_LOOKUP, rob.getCount());
+        if (kind == MOVE_IDIOM && !rob.findVal(src, value, curThread))
+            value = registers[src];
+        rob.markReady(rbInd, value);
+        regStatus[inst.dst] = -1;
+        recordExecStart(j);
+        recordExecEnd(j);
+        recordWrite(j);
+    }
+    if (kind == MOVE_IDIOM)
+        eliminatedMoves++;
+    else if (kind == ZERO_IDIOM)
+        eliminatedZeros++;
+    else
+        eliminatedR0++;
+    regStatus[0] = -1;
+    pc++;
+    dynamicCount++;
+    return true;
+}
+
+// The producer in RS index producer wrote value back: the moves waiting on it are done
+void completeMoves(int producer, int16_t value) {
+    for (size_t k = 0; k < pendingMoves.size();) {
+        if (pendingMoves[k].first != producer) {
+            k++;
+            continue;
+        }
+        int j = rob.getInstId(pendingMoves[k].second);
+        rob.markReady(pendingMoves[k].second, value);
+        recordExecStart(j);
+        recordExecEnd(j);
+        recordWrite(j);
+        pendingMoves[k] = pendingMoves.back();
+        pendingMoves.pop_back();
+    }
+}
+
+// After a flush, forgets the moves that were squashed
+void dropFlushedMoves() {
+    for (size_t k = 0; k < pendingMoves.size();) {
+        int index = pendingMoves[k].second;
+        if (rob.isBusy(index) && !rob.isSquashed(index)) {
+            k++;
+            continue;
+        }
+        pendingMoves[k] = pendingMoves.back();
+        pendingMoves.pop_back();
+    }
+}
+
+bool issueInstruction(const Instruction& inst) {
+    if (useIdiomElimination) {
+        IdiomKind kind = idiomOf(inst);
+        if (kind != NO_IDIOM)
+            return eliminateInstruction(inst, kind);
+    }
+    int ind;
+    if (!canIssue(inst, ind)) {
+        //pc++;
+        return false;
+    }
+    int j = recordIssue(pc);
+    int rbInd = rob.allocate(inst.opcode, inst.dst, j, curThread);
+    stores[rbInd] = { NOT_A_STORE,0,0 };
+    loads[rbInd] = { 0,0,-1 };
+    if (traceMode == TRACE_REPLAY)
+        replayIssue(inst, rbInd);
+    if (useProfile)
+        robIssue[rbInd] = { pc, cycle };
+    energy.count(EV_ISSUE);
+    energy.count(EV_ROB_WRITE);
+    energy.count(EV_ROB_LOOKUP, rob.getCount() * ((inst.src1 > 0) + (inst.src2 > 0)));
+    int16_t val1 = -1, val2 = -1;
+    // R0 is always read as 0, even while an instruction that names it as destination is in flight
+    if (inst.src1 >= 0 && (inst.src1 == 0 || !rob.findVal(inst.src1, val1, curThread)))
+        val1 = registers[inst.src1];
+    if (inst.src2 >= 0 && (inst.src2 == 0 || !rob.findVal(inst.src2, val2, curThread)))
+        val2 = registers[inst.src2];
+    switch (inst.opcode) {
+    case 'l':
+        reservationStations[ind] = RSEntry(true, inst.opcode, val1, val2, regStatus[inst.src1], -1, rbInd, cycles_num[0], inst.imm, j);
+        regStatus[inst.dst] = ind;
         break;
     case 't':
         reservationStations[ind] = RSEntry(true, inst.opcode, val1, val2, regStatus[inst.src1], regStatus[inst.src2], rbInd, cycles_num[1], inst.imm, j);
-        stores[rbInd][0] = -2;
+        stores[rbInd][0] = ADDRESS_UNKNOWN;
         break;
     case 'b':
         reservationStations[ind] = RSEntry(true, inst.opcode, val1, val2, regStatus[inst.src1], regStatus[inst.src2], rbInd, cycles_num[2], inst.pc + inst.imm + 1, j);
@@ -648,30 +1692,219 @@ void issueInstruction(const Instruction& inst) {
     default:
         cout << "Undefined Instruction\n";
     }
+    if (useValuePrediction) {
+        usePredictedValues(reservationStations[ind]);
+        if (inst.opcode == 'l')
+            predictLoad(ind);
+    }
     regStatus[0] = -1;
     pc++;
     dynamicCount++;
+    return true;
+}
+
+// Tries the contexts in fetch-policy order; the first one that can issue gets the issue slot
+void issueSMT() {
+    vector<int> order;
+    for (int i = 1; i <= smtThreads; i++)
+        order.push_back((lastFetched + i) % smtThreads);
+    if (fetchPolicy == 1)             // ICOUNT: fewest instructions in flight first
+        stable_sort(order.begin(), order.end(), [](int a, int b) { return rob.countOf(a) < rob.countOf(b); });
+    for (int t : order) {
+        if (!threadFetching(t))
+            continue;
+        switchContext(t);
+        if (issueInstruction(programMemory[pc])) {
+            lastFetched = t;
+            return;
+        }
+    }
+}
+
+
+// Fetch front end
+
+void initFrontEnd() {
+    icache = ICache(ICacheLines, ICacheLineSize);
+    fetchQueue.clear();
+    fetchPc = pc;
+    fetchStallUntil = 0;
+}
+
+// After a flush the queue holds wrong-path instructions; fetch restarts at the new pc,
+// so the redirect costs frontEndDepth cycles plus any I-cache miss
+void redirectFrontEnd() {
+    fetchQueue.clear();
+    fetchPc = pc;
+    redirects++;
+}
+
+// Fetches up to fetchWidth instructions from one cache line into the fetch queue
+void fetchInstructions() {
+    if (cycle < fetchStallUntil)
+        return;
+    for (int n = 0; n < fetchWidth; n++) {
+        if ((int)fetchQueue.size() >= fetchQueueSize || fetchPc >= (int)programMemory.size())
+            return;
+        if (n > 0 && icache.lineOf(fetchPc) != icache.lineOf(fetchPc - 1))
+            return;
+        if (!icache.access(fetchPc)) {
+            fetchStallUntil = cycle + ICacheMissTime;
+            return;
+        }
+        fetchQueue.push_back({ fetchPc, cycle + frontEndDepth });
+        fetchPc++;
+        fetchedCount++;
+    }
+}
+
+void issueFromFetchQueue() {
+    if (fetchQueue.empty() || fetchQueue.front().readyCycle > cycle) {
+        if (pc < (int)programMemory.size())
+            starvedCycles++;
+        return;
+    }
+    if (issueInstruction(programMemory[fetchQueue.front().pc]))
+        fetchQueue.pop_front();
 }
 
 
 // Phase 3: Execute
 
+int robPc(int robIndex) {
+    return records[rob.getInstId(robIndex)][0];
+}
+
 bool canLoad(int robId, int address, int& val, bool& other) {
     vector<bool> sts(ROBSize, false);
-    for (int i = 0; i < ROBSize; i++)
-        if (stores[i][0] == -2 || stores[i][0] == address)
+    vector<bool> unresolved(ROBSize, false);
+    for (int i = 0; i < ROBSize; i++) {
+        if (stores[i][0] == address)
             sts[i] = true;
+        else if (stores[i][0] == ADDRESS_UNKNOWN) {
+            unresolved[i] = true;
+            if (!useStoreSets || storeSets.sameSet(robPc(robId), robPc(i)))
+                sts[i] = true;
+        }
+    }
     int ans = rob.chooseStore(sts, robId);
+    if (ans != robId && !stores[ans][1])
+        return false;
+    if (useStoreSets) {
+        for (int i = 0; i < ROBSize; i++)
+            unresolved[i] = unresolved[i] || sts[i];
+        if (rob.chooseStore(unresolved, robId) != ans)      // an older store was skipped
+            storeSets.earlyLoads++;
+    }
+    loads[robId] = { 1, address, ans == robId ? -1 : ans };
     if (ans == robId)
         return true;
-    if (stores[ans][1]) {
-        val = stores[ans][2];
-        other = true;
-        return true;
+    val = stores[ans][2];
+    other = true;
+    return true;
+}
+
+// A store just resolved its address: returns the oldest younger load that already read that
+// address without getting the value from this store or a younger one, or -1
+int findViolation(int storeRob, int address) {
+    int storeAge = rob.age(storeRob);
+    for (int i : rob.inOrder()) {
+        if (rob.age(i) <= storeAge || !loads[i][0] || loads[i][1] != address)
+            continue;
+        if (loads[i][2] == -1 || rob.age(loads[i][2]) < storeAge)
+            return i;
     }
-    else {
-        return false;
+    return -1;
+}
+
+void rebuildRegStatus() {
+    for (int i = 0; i < NUM_REGS; i++)
+        regStatus[i] = -1;
+    for (int index : rob.inOrder()) {
+        pair<int, int> typevalue = rob.getData(index);
+        if (!ROB::writesRegister(typevalue.first) && typevalue.first != 'c')
+            continue;
+        int reg = typevalue.first == 'c' ? 1 : rob.getDest(index);
+        regStatus[reg] = -1;
+        for (int i = 0; i < TotalReserveStations; i++)
+            if (reservationStations[i].busy && reservationStations[i].robIndex == index)
+                regStatus[reg] = i;
+        for (auto& move : pendingMoves)
+            if (move.second == index)
+                regStatus[reg] = move.first;
     }
+    regStatus[0] = -1;
+}
+
+// After a squash, counts the instances of each load still in flight again
+void recountPredictedLoads() {
+    valuePredictor.clearInFlight();
+    for (int index : rob.inOrder())
+        if (rob.getData(index).first == 'l')
+            valuePredictor.addInFlight(robPc(index));
+}
+
+// The load at loadRob commits value
+void trainPredictor(int loadRob, int16_t value) {
+    int loadPc = robPc(loadRob);
+    int younger = 0;
+    if (!valuePredictor.tracks(loadPc))
+        for (int index : rob.inOrder())
+            if (index != loadRob && rob.getData(index).first == 'l' && robPc(index) == loadPc)
+                younger++;
+    valuePredictor.train(loadPc, value, younger);
+}
+
+// The load in station wrote back value: checks what its dependents were given
+void verifyPrediction(int station, int16_t value) {
+    int predicted = predictedValue[station];
+    predictedValue[station] = NO_PREDICTION;
+    if (predicted == NO_PREDICTION)
+        return;
+    if (predicted == value) {
+        valuePredictor.correct++;
+        return;
+    }
+    valuePredictor.wrong++;
+    int loadRob = reservationStations[station].robIndex;
+    if (rob.age(loadRob) + 1 == rob.getCount())        // nothing younger has used it yet
+        return;
+    energy.count(EV_FLUSH);
+    if (useProfile)
+        profileOf(loadRob).flushes++;
+    valuePredictor.squashed += rob.flushFrom((loadRob + 1) % ROBSize);
+    for (auto& rs : reservationStations)
+        if (rs.busy && !rob.isBusy(rs.robIndex))
+            rs.busy = false;
+    dropFlushedMoves();
+    rebuildRegStatus();
+    recountPredictedLoads();
+    pc = robPc(loadRob) + 1;
+    if (useFrontEnd)
+        redirectFrontEnd();
+}
+
+// Squashes a load that read stale data and everything younger, and refetches from the load
+void replayLoad(int loadRob, int storeRob) {
+    int loadPc = robPc(loadRob);
+    energy.count(EV_FLUSH);
+    storeSets.recordViolation(loadPc, robPc(storeRob));
+    storeSets.lostCycles += cycle - records[rob.getInstId(loadRob)][1];
+    storeSets.squashed += rob.flushFrom(loadRob);
+    if (useProfile)
+        profileOf(loadRob).flushes++;
+    if (traceMode == TRACE_REPLAY)
+        rewindReplay(loadRob);
+    for (auto& rs : reservationStations)
+        if (rs.busy && !rob.isBusy(rs.robIndex))
+            rs.busy = false;
+    dropFlushedMoves();
+    rebuildRegStatus();
+    if (useValuePrediction)
+        recountPredictedLoads();
+    pc = loadPc;
+    if (useFrontEnd)
+        redirectFrontEnd();
 }
 
 void decrementExecutionTimers() {
@@ -681,11 +1914,17 @@ void decrementExecutionTimers() {
                 recordExecStart(rs.instId);
                 rs.executionCyclesLeft--;
             }
+            else if (useProfile && rs.executionCyclesLeft > 0 && rs.Qj != &rs - &reservationStations[0])
+                profileOf(rs.robIndex).operandWait++;          // (a written-back store waits on itself until commit)
             if (rs.op == 'l' && rs.executionCyclesLeft == 0 && rs.Qk != -2) {
                 bool other = false;
                 int val;
-                if (!canLoad(rs.robIndex, rs.address + rs.Vj, val, other))
+                int address = replayed(rs, rs.address + rs.Vj);
+                if (!canLoad(rs.robIndex, address, val, other)) {
                     rs.executionCyclesLeft = 1;                  // wait another cycle
+                    if (useProfile)
+                        profileOf(rs.robIndex).loadWait++;
+                }
                 else {
                     if (other) {                               // USE THE EMPTY Qk AND Vk TO GET THINGS FROM STORES
                         rs.Vk = val;
@@ -693,8 +1932,16 @@ void decrementExecutionTimers() {
                     }
                     else
                     {
-                        rs.executionCyclesLeft = ReadMemoryTime;
-                        rs.Vk = dataMemory[rs.Vj + rs.address];
+                        bool coherenceMiss;
+                        rs.executionCyclesLeft = loadLatency(address, coherenceMiss);
+                        if (usePrefetcher) {
+                            long long before = prefetcher.issued;
+                            int key = (rob.getThread(rs.robIndex) << 20) | robPc(rs.robIndex);
+                            rs.executionCyclesLeft = prefetcher.demand(key, address, cycle,
+                                rs.executionCyclesLeft, !coherenceMiss);
+                            energy.count(EV_MEM_READ, prefetcher.issued - before);
+                        }
+                        rs.Vk = readMemory(address);
                         rs.Qk = -2;
                     }
                 }
@@ -722,11 +1969,17 @@ void writeBackResults() {
         return;
 
     int index = rob.getFirst(ready);
+    if (useProfile)
+        for (int i = 0; i < TotalReserveStations; i++)
+            if (ready[i] != -1 && i != index)
+                profileOf(ready[i]).busWait++;
+    switchContext(rob.getThread(reservationStations[index].robIndex));
+    energy.count(EnergyCounters::unitEvent(reservationStations[index].op));
+    energy.count(EV_WAKEUP, TotalReserveStations);
+    energy.count(EV_ROB_WRITE);
     for (int i=0;i<NUM_REGS;i++)
-        if (regStatus[i] == index) {
-            regStatus[i] = -1;
-            break;
-        }
+        if (regStatus[i] == index)
+            regStatus[i] = -1;             // an eliminated move can make several registers wait on one producer
 
     int16_t value = -1;
     switch (reservationStations[index].op) {
@@ -734,14 +1987,14 @@ void writeBackResults() {
         value = reservationStations[index].Vk;
         break;
     case 't':
-        value = reservationStations[index].Vk;
-        stores[reservationStations[index].robIndex][0] = reservationStations[index].address + reservationStations[index].Vj;
+        value = reservationStations[index].Vj;            // Vj holds the stored register, Vk the base
+        stores[reservationStations[index].robIndex][0] = replayed(reservationStations[index], reservationStations[index].address + reservationStations[index].Vk);
         stores[reservationStations[index].robIndex][1] = 1;
         stores[reservationStations[index].robIndex][2] = value;
         rob.changeDest(reservationStations[index].robIndex, stores[reservationStations[index].robIndex][0]);
         break;
     case 'b':
-        value = (reservationStations[index].Vj == reservationStations[index].Vk);
+        value = replayed(reservationStations[index], reservationStations[index].Vj == reservationStations[index].Vk);
         rob.changeDest(reservationStations[index].robIndex, reservationStations[index].address);
         break;
     case 'c':
@@ -749,7 +2002,7 @@ void writeBackResults() {
         rob.changeDest(reservationStations[index].robIndex, reservationStations[index].address);
         break;
     case 'r':
-        rob.changeDest(reservationStations[index].robIndex, reservationStations[index].Vj);
+        rob.changeDest(reservationStations[index].robIndex, replayed(reservationStations[index], reservationStations[index].Vj));
         break;
     case 'a':
         value = reservationStations[index].Vj + reservationStations[index].Vk;
@@ -777,6 +2030,8 @@ void writeBackResults() {
         }
     }
     rob.markReady(reservationStations[index].robIndex, value);
+    if (!pendingMoves.empty())
+        completeMoves(index, value);
     if (reservationStations[index].op != 't')
         reservationStations[index].busy = false;
     else{ 
@@ -784,15 +2039,136 @@ void writeBackResults() {
         reservationStations[index].executionCyclesLeft = cycles_num[1];
     }
     recordWrite(reservationStations[index].instId);
+    if (useIntervalStats && reservationStations[index].op == 'l') {
+        interval.loadLatencySum += cycle - records[reservationStations[index].instId][1];
+        interval.loads++;
+    }
+    if (useValuePrediction && reservationStations[index].op == 'l')
+        verifyPrediction(index, value);
+
+    if (useStoreSets && reservationStations[index].op == 't') {
+        int storeRob = reservationStations[index].robIndex;
+        int load = findViolation(storeRob, stores[storeRob][0]);
+        if (load != -1)
+            replayLoad(load, storeRob);
+    }
+}
+
+
+// Critical-path analysis
+// The committed instructions are fed to dependency-graph models (CriticalPath.cpp) as they
+// commit: one with the configuration being run, one without any resource limit (the dataflow
+// limit), and one per what-if: each latency one cycle shorter, each unit with one more station,
+// and a ROB twice the size. Register links follow program order, which is what issue resolves
+// through regStatus and the ROB for the committed path; store-to-load links use the addresses.
+
+void startCriticalPath() {
+    PathParams base;
+    base.robSize = ROBSize;
+    copy(reserve_num, reserve_num + 7, base.stations.begin());
+    copy(cycles_num, cycles_num + 7, base.latency.begin());
+    base.readMemory = ReadMemoryTime;
+    base.writeMemory = WriteMemoryTime;
+    pathModels.clear();
+    pathModelNames.clear();
+    auto addModel = [](const PathParams& params, const string& name) {
+        pathModels.emplace_back(params);
+        pathModelNames.push_back(name);
+    };
+    addModel(base, "");
+    PathParams dataflow = base;
+    dataflow.dataflowOnly = true;
+    addModel(dataflow, "");
+    for (int u = 0; u < 7; u++)
+        if (base.latency[u] > 1) {
+            PathParams faster = base;
+            faster.latency[u]--;
+            addModel(faster, string(unitNames[u]) + " latency " + to_string(base.latency[u]) + "->" + to_string(faster.latency[u]));
+        }
+    for (int u = 0; u < 7; u++) {
+        PathParams wider = base;
+        wider.stations[u]++;
+        addModel(wider, string(unitNames[u]) + " stations " + to_string(base.stations[u]) + "->" + to_string(wider.stations[u]));
+    }
+    PathParams bigger = base;
+    bigger.robSize *= 2;
+    addModel(bigger, "ROB " + to_string(base.robSize) + "->" + to_string(bigger.robSize));
+}
+
+void addToCriticalPath(int robIndex, char op, int dest, int value) {
+    const Instruction& inst = programMemory[robPc(robIndex)];
+    PathInst in;
+    in.op = op;
+    in.dst = inst.dst;
+    in.src1 = inst.src1;
+    in.src2 = inst.src2;
+    in.address = op == 'l' ? loads[robIndex][1] : op == 't' ? dest : 0;
+    in.redirect = op == 'c' || op == 'r' || (op == 'b' && value);
+    for (auto& model : pathModels)
+        model.add(in);
+}
+
+void printCriticalPath(ostream& out, int item) {
+    static const char* partNames[NUM_PATH_PARTS] = {
+        "issue", "load unit", "store unit", "beq unit", "call/ret unit", "add/sub unit", "nand unit", "mul unit",
+        "memory read", "memory write", "commit", "register dependences", "store-to-load forwards",
+        "waits for older stores", "ROB full", "all stations busy", "flushes"
+    };
+    const PathTime& path = pathModels[0].critical();
+    long long modelCycles = path.t;
+    out << item << ". Critical path: " << modelCycles << " cycles in the dependency-graph model (the run took " << cycle
+        << "), dataflow limit " << pathModels[1].critical().t << " cycles\n";
+    out << "   Share of the critical path:";
+    const char* sep = " ";
+    for (int part = 0; part < NUM_PATH_CYCLES; part++)
+        if (path.parts[part] > 0) {
+            out << sep << partNames[part] << " " << 100.0 * path.parts[part] / modelCycles << "%";
+            sep = ", ";
+        }
+    out << "\n   Edges on the critical path:";
+    sep = " ";
+    for (int part = NUM_PATH_CYCLES; part < NUM_PATH_PARTS; part++) {
+        out << sep << path.parts[part] << " " << partNames[part];
+        sep = ", ";
+    }
+    out << "\n   What if (model cycles):";
+    sep = " ";
+    for (size_t m = 2; m < pathModels.size(); m++) {
+        long long cycles = pathModels[m].critical().t;
+        out << sep << pathModelNames[m] << ": " << cycles << " (" << (cycles <= modelCycles ? "" : "+")
+            << 100.0 * (cycles - modelCycles) / modelCycles << "%)";
+        sep = ", ";
+    }
+    out << endl;
 }
 
 
 // Phase 5: Commit
 
-int commitLater = -1;            // has entries that need to be freed after data is written to the memory in WriteMemoryTime cycles
+thread_local int commitLater = -1;          // has entries that need to be freed after data is written to the memory in WriteMemoryTime cycles
 // 2 entries: reservation stage index, when? (how many cycles left)
 
+void flushThread() {            // SMT: only the active context's instructions behind the head are squashed
+    int head;
+    rob.canCommit(head);
+    for (auto& rs : reservationStations)
+        if (rs.busy && rs.robIndex != head && rob.getThread(rs.robIndex) == curThread)
+            rs.busy = false;
+    for (int i = 0; i < NUM_REGS; i++)
+        regStatus[i] = -1;
+    rob.squashThread(curThread);
+    for (int i = 0; i < ROBSize; i++)
+        if (rob.isSquashed(i))
+            stores[i] = { NOT_A_STORE,0,0 };
+    dropFlushedMoves();
+}
+
 void flushPipeline() {          // For branch misprediction
+    energy.count(EV_FLUSH);
+    if (smtThreads > 1) {
+        flushThread();
+        return;
+    }
     for (auto& rs : reservationStations) {
         rs.busy = false;
     }
@@ -800,41 +2176,64 @@ void flushPipeline() {          // For branch misprediction
         regStatus[i] = -1;
     }
     rob.flushAfter();
+    pendingMoves.clear();
+    wrongPath = false;
+    if (useValuePrediction)
+        recountPredictedLoads();
+    if (useFrontEnd)
+        redirectFrontEnd();
 }
 
 
 void commitInstruction() {
     int front;
     commitLater--;
+    rob.dropSquashed();
     if (!rob.canCommit(front) || commitLater > 0)
         return;
-    int16_t dest = rob.getDest(front);
+    switchContext(rob.getThread(front));
+    int dest = rob.getDest(front);
     if (commitLater == 0) {
         for (int i = 0; i < TotalReserveStations; i++)
-            if (reservationStations[i].robIndex == dest)
+            if (reservationStations[i].busy && reservationStations[i].robIndex == front)
                 reservationStations[i].busy = false;
         recordCommit(rob.getPC());
+        contexts[curThread].committed++;
+        interval.committed++;
+        if (useProfile)
+            profileCommit(front);
         rob.commit();
         commitLater--;
         return;
     }
     commitLater = -1;
+    energy.count(EV_ROB_READ);
     pair<int, int> typevalue;
     typevalue = rob.getData(front);
+    if (traceMode != TRACE_OFF)
+        traceCommit(front, typevalue.first, dest, typevalue.second);
+    if (useCriticalPath)
+        addToCriticalPath(front, typevalue.first, dest, typevalue.second);
+    if (useProfile && (typevalue.first == 'c' || typevalue.first == 'r' || (typevalue.first == 'b' && typevalue.second)))
+        profileOf(front).flushes++;
     switch (typevalue.first) {
     case 'l':
         registers[dest] = typevalue.second;
+        if (useValuePrediction)
+            trainPredictor(front, typevalue.second);
         break;
     case 't':
-        dataMemory[dest] = typevalue.second;
+        writeMemory(dest, typevalue.second);
         commitLater = WriteMemoryTime - 1;
         break;
     case 'b':
         branches++;
+        contexts[curThread].branches++;
         if (typevalue.second) {
             pc = dest;
             flushPipeline();
             mispred++;
+            contexts[curThread].mispred++;
         }
         break;
     case 'c':
@@ -862,6 +2261,10 @@ void commitInstruction() {
     registers[0] = 0;
     if (typevalue.first != 't') {
         recordCommit(rob.getPC());
+        contexts[curThread].committed++;
+        interval.committed++;
+        if (useProfile)
+            profileCommit(front);
         rob.commit();
     }
 }
@@ -871,37 +2274,1451 @@ void commitInstruction() {
 // Phase 6: Statistics / Logging
 
 
-void printResults() {
-    cout << "pc:  issue time, execution start time, execution end time, write back time, commit time\n";
-    for (int i = 0; i < records.size(); i++) {
-        cout << records[i][0] + pcStart << ": ";
+void printResults(ostream& out = cout) {
+    out << "pc:  issue time, execution start time, execution end time, write back time, commit time\n";
+    for (int i = 0; i < (int)records.size(); i++) {
+        if (smtThreads > 1)
+            out << "T" << recordThread[i] << " " << records[i][0] + threadPcStart(recordThread[i]) << ": ";
+        else
+            out << records[i][0] + pcStart << ": ";
         for (int j = 1; j < 6; j++) {
             if (j >= records[i].size())
-                cout << "- 1  ";
+                out << "- 1  ";
             else
-                cout << records[i][j] << "  ";
+                out << records[i][j] << "  ";
         }
-        cout << endl;
+        out << "\n";          // no flush per row, the table can have millions of rows
+    }
+    out << "\n2. The total number of cycles the program took is: " << --cycle << endl;
+    out << "3. The IPC is: " << static_cast<double>(dynamicCount) / cycle << ", the CPI is: " << static_cast<double>(cycle) / dynamicCount << endl;
+    out << "4. The branch misprediction percentage is: " << mispred * 100 / (branches > 0 ? branches : 1) << "%\n";
+    int item = 5;
+    if (numCores > 1) {
+        out << item++ << ". Coherence invalidations received: " << cores[coreId].invalidations
+            << ", coherence misses: " << cores[coreId].coherenceMisses << endl;
+    }
+    if (smtThreads > 1) {
+        out << item++ << ". Per-context results:\n";
+        for (int t = 0; t < smtThreads; t++)
+            out << "   Context " << t << ": committed " << contexts[t].committed << " instructions, IPC "
+                << static_cast<double>(contexts[t].committed) / cycle << ", branch misprediction "
+                << contexts[t].mispred * 100 / (contexts[t].branches > 0 ? contexts[t].branches : 1) << "%\n";
+    }
+    if (useStoreSets) {
+        long long early = storeSets.earlyLoads;
+        out << item++ << ". Store sets: " << early << " loads went ahead of an unresolved store, "
+            << storeSets.violations << " of them were violations (prediction accuracy "
+            << (early > 0 ? 100.0 * (early - storeSets.violations) / early : 100.0) << "%)\n";
+        out << "   Replay cost: " << storeSets.squashed << " instructions squashed, "
+            << storeSets.lostCycles << " cycles between issue and replay of the violating loads\n";
+    }
+    if (useFrontEnd) {
+        out << item++ << ". Front end: " << fetchedCount << " instructions fetched, " << redirects << " redirects, "
+            << starvedCycles << " cycles with nothing ready to issue\n";
+        out << "   Instruction cache: " << icache.accesses << " accesses, " << icache.misses << " misses ("
+            << (icache.accesses > 0 ? 100.0 * icache.misses / icache.accesses : 0.0) << "%)\n";
+    }
+    if (useIdiomElimination)
+        out << item++ << ". Eliminated at issue: " << eliminatedMoves << " moves, " << eliminatedZeros << " zero idioms, "
+            << eliminatedR0 << " writes to R0 (" << (dynamicCount > 0 ? 100.0 * (eliminatedMoves + eliminatedZeros + eliminatedR0) / dynamicCount : 0.0)
+            << "% of issued instructions)\n";
+    if (usePrefetcher) {
+        long long demands = prefetcher.demands, hits = prefetcher.hits;
+        out << item++ << ". Prefetcher: " << prefetcher.issued << " prefetches issued, " << hits << " of "
+            << demands << " loads from memory hit a prefetch\n";
+        out << "   Coverage: " << (demands > 0 ? 100.0 * hits / demands : 0.0) << "%, accuracy: "
+            << (prefetcher.issued > 0 ? 100.0 * hits / prefetcher.issued : 0.0) << "%, timeliness: "
+            << (hits > 0 ? 100.0 * prefetcher.timely / hits : 0.0) << "% of hits arrived in time, "
+            << prefetcher.savedCycles << " load cycles saved\n";
+    }
+    if (useValuePrediction) {
+        const ValuePredictor& vp = valuePredictor;
+        long long checked = vp.correct + vp.wrong;
+        out << item++ << ". Value prediction: " << vp.predictions << " of " << vp.lookups << " loads issued got a predicted value, "
+            << vp.correct << " of the " << checked << " checked at write back were right\n";
+        out << "   Coverage: " << (vp.lookups > 0 ? 100.0 * vp.predictions / vp.lookups : 0.0) << "%, accuracy: "
+            << (checked > 0 ? 100.0 * vp.correct / checked : 100.0) << "%, " << vp.squashed << " instructions squashed on "
+            << vp.wrong << " mispredictions\n";
+        if (predictionBaseline > 0)
+            out << "   Net cycle gain: " << predictionBaseline - cycle << " cycles (" << 100.0 * (predictionBaseline - cycle) / predictionBaseline
+                << "% of the " << predictionBaseline << " cycles the run takes without value prediction)\n";
+    }
+    if (useEnergy) {
+        EnergyReport report = estimateEnergy(energyParams, energy, cycle, ROBSize, TotalReserveStations);
+        out << item++ << ". Energy: " << report.energyNJ() << " nJ (dynamic " << report.dynamicPJ / 1000 << " nJ, leakage "
+            << report.leakagePJ / 1000 << " nJ), average power: " << report.powerMW() << " mW at " << energyParams.clockGHz
+            << " GHz, energy-delay product: " << report.edp() << " nJ*ns\n";
+        out << "   Dynamic energy by event (nJ):";
+        const char* sep = " ";
+        for (int e = 0; e < NUM_ENERGY_EVENTS; e++)
+            if (energy.events[e] > 0) {
+                out << sep << EnergyParams::name(e) << " " << energyParams.event[e] * energy.events[e] / 1000;
+                sep = ", ";
+            }
+        out << endl;
+    }
+    if (useIntervalStats && statsStream.samples > 0)
+        out << item++ << ". Interval statistics: " << statsStream.samples << " samples written to " << statsStream.path << endl;
+    if (useProfile) {
+        out << item++ << ". Per-instruction profile, sorted by the cycles each instruction held the head of the ROB:\n";
+        printProfile(out);
+    }
+    if (useCriticalPath)
+        printCriticalPath(out, item++);
+    if (traceMode == TRACE_RECORD && traceWriter.bytes > 0)
+        out << item++ << ". Trace: " << traceWriter.header.committed << " committed instructions, " << traceWriter.header.outcomes
+            << " outcomes, " << traceWriter.bytes << " bytes written to " << traceWriter.path << endl;
+    if (traceMode == TRACE_REPLAY) {
+        const TraceHeader& h = traceReader.header;
+        out << item++ << ". Trace: replayed " << traceReader.consumed << " of " << h.outcomes << " outcomes and "
+            << contexts[0].committed << " of " << h.committed << " committed instructions from " << traceReader.path << endl;
+        if (traceReader.exhausted || traceReader.consumed != h.outcomes || contexts[0].committed != h.committed)
+            out << "   The run did not follow the trace, the results are not valid\n";
     }
-    cout << "\n2. The total number of cycles the program took is: " << --cycle << endl;
-    cout << "3. The IPC is: " << static_cast<double>(dynamicCount) / cycle << ", the CPI is: " << static_cast<double>(cycle) / dynamicCount << endl;
-    cout << "4. The branch misprediction percentage is: " << mispred * 100 / (branches > 0 ? branches : 1) << "%\n";
+}
+
+
+// Interval statistics
+// The counters in interval are turned into one IntervalSample every statsInterval cycles (or
+// committed instructions) and streamed to statsPath; the partial last interval is written at the end.
+
+void startIntervalStats() {
+    string path = statsPath;
+    if (numCores > 1) {
+        size_t dot = path.find_last_of('.'), slash = path.find_last_of("/\\");
+        string suffix = "." + to_string(coreId);
+        if (dot == string::npos || (slash != string::npos && dot < slash))
+            path += suffix;
+        else
+            path.insert(dot, suffix);
+    }
+    if (!statsStream.open(path, statsBinary))
+        cout << "Could not open " << path << ", no interval statistics will be written\n";
+    interval = IntervalCounters();
+    interval.startCycle = cycle;
+    interval.startBranches = branches;
+    interval.startMispred = mispred;
+}
+
+// Samples are stamped with the cycle count printResults() would report at that point, one less
+// than the cycles stepped, so the last partial interval ends at the reported total
+void emitSample() {
+    IntervalSample s;
+    s.cycle = cycle - 1;
+    s.cycles = s.cycle - interval.startCycle;
+    s.committed = interval.committed;
+    s.ipc = s.cycles > 0 ? static_cast<double>(s.committed) / s.cycles : 0.0;
+    int intervalBranches = branches - interval.startBranches;
+    s.mispredRate = intervalBranches > 0 ? 100.0 * (mispred - interval.startMispred) / intervalBranches : 0.0;
+    s.robOccupancy = s.cycles > 0 ? static_cast<double>(interval.robSum) / s.cycles : 0.0;
+    s.rsOccupancy = s.cycles > 0 ? static_cast<double>(interval.rsSum) / s.cycles : 0.0;
+    s.loadLatency = interval.loads > 0 ? static_cast<double>(interval.loadLatencySum) / interval.loads : 0.0;
+    if (statsStream.isOpen())
+        statsStream.write(s);
+
+    interval = IntervalCounters();
+    interval.startCycle = cycle - 1;
+    interval.startBranches = branches;
+    interval.startMispred = mispred;
+}
+
+// Called once at the end of every cycle
+void sampleCycle() {
+    interval.robSum += rob.getCount();
+    for (auto& rs : reservationStations)
+        if (rs.busy)
+            interval.rsSum++;
+    if (statsByCommits ? interval.committed >= statsInterval : cycle - 1 - interval.startCycle >= statsInterval)
+        emitSample();
+}
+
+void finishIntervalStats() {
+    if (cycle - 1 > interval.startCycle)
+        emitSample();
+    statsStream.close();
+}
+
+
+// Fixed-configuration cores
+// The pipeline of phases 2-5 with every size and latency known at compile time: std::array
+// storage, power-of-two ROB masks and a constexpr opcode table in place of reserve_start[]
+// and the opcode switches. runSimulator() uses one when the chosen configuration matches
+// one of the standard configurations below; anything else runs on the generic path.
+// Build with -DNO_FIXED_CORES to leave them out.
+
+#ifndef NO_FIXED_CORES
+
+enum AddressKind { ADDR_IMM, ADDR_BRANCH, ADDR_CALL };
+
+struct OpInfo {
+    int unit = -1;                  // reservation station group (index into reserve_num / cycles_num)
+    bool setsRegStatus = false;
+    AddressKind address = ADDR_IMM;
+};
+
+constexpr array<OpInfo, 128> makeOpTable() {
+    array<OpInfo, 128> t{};
+    t['l'] = { 0, true, ADDR_IMM };
+    t['t'] = { 1, false, ADDR_IMM };
+    t['b'] = { 2, false, ADDR_BRANCH };
+    t['c'] = { 3, true, ADDR_CALL };
+    t['r'] = { 3, false, ADDR_IMM };
+    t['a'] = { 4, true, ADDR_IMM };
+    t['s'] = { 4, true, ADDR_IMM };
+    t['n'] = { 5, true, ADDR_IMM };
+    t['m'] = { 6, true, ADDR_IMM };
+    return t;
+}
+
+constexpr array<OpInfo, 128> opTable = makeOpTable();
+
+constexpr array<int, 8> stationStarts(const array<int, 7>& stations) {
+    array<int, 8> start{};
+    for (int u = 0; u < 7; u++)
+        start[u + 1] = start[u] + stations[u];
+    return start;
+}
+
+struct DefaultConfig {              // the defaults of chooseVariables()
+    static constexpr int robSize = 8;
+    static constexpr array<int, 7> stations = { 2, 1, 2, 1, 4, 2, 1 };
+    static constexpr array<int, 7> latency = { 2, 2, 1, 1, 2, 1, 12 };
+    static constexpr int readTime = 4;
+    static constexpr int writeTime = 4;
+};
+
+struct LargeConfig {                // twice the ROB and the busiest station groups
+    static constexpr int robSize = 16;
+    static constexpr array<int, 7> stations = { 4, 2, 2, 1, 8, 2, 2 };
+    static constexpr array<int, 7> latency = { 2, 2, 1, 1, 2, 1, 12 };
+    static constexpr int readTime = 4;
+    static constexpr int writeTime = 4;
+};
+
+template<class Cfg>
+class FixedCore {
+    static_assert((Cfg::robSize & (Cfg::robSize - 1)) == 0, "ROB size must be a power of two");
+    static constexpr int robMask = Cfg::robSize - 1;
+    static constexpr array<int, 8> start = stationStarts(Cfg::stations);
+    static constexpr int totalStations = start[7];
+
+    array<RSEntry, totalStations> rs;
+    array<ROBEntry, Cfg::robSize> entries;
+    array<array<int, 3>, Cfg::robSize> storeSlots;     // same layout as stores[]
+    int head = 0;
+    int tail = 0;
+    int count = 0;
+    int storeCommit = -1;                               // same role as commitLater
+
+    bool canIssue(const Instruction& inst, int& i) const {
+        if (count == Cfg::robSize)
+            return false;
+        int unit = opTable[inst.opcode].unit;
+        for (i = start[unit]; i < start[unit + 1]; i++)
+            if (!rs[i].busy)
+                return true;
+        return false;
+    }
+
+    bool findVal(int dest, int16_t& value) const {
+        int index = tail;
+        do {
+            index = (index - 1) & robMask;
+            if (entries[index].ready && ROB::writesRegister(entries[index].type) && entries[index].destination == dest) {
+                value = entries[index].value;
+                return true;
+            }
+        } while (index != head);
+        return false;
+    }
+
+    void issue(const Instruction& inst) {
+        int ind;
+        if (!canIssue(inst, ind))
+            return;
+        const OpInfo& info = opTable[inst.opcode];
+        int j = recordIssue(pc);
+        int rbInd = tail;
+        entries[tail] = ROBEntry(inst.opcode, inst.dst, 0, j, 0);
+        tail = (tail + 1) & robMask;
+        count++;
+        storeSlots[rbInd] = { NOT_A_STORE,0,0 };
+
+        int16_t val1 = -1, val2 = -1;
+        if (inst.src1 >= 0 && (inst.src1 == 0 || !findVal(inst.src1, val1)))
+            val1 = registers[inst.src1];
+        if (inst.src2 >= 0 && (inst.src2 == 0 || !findVal(inst.src2, val2)))
+            val2 = registers[inst.src2];
+        int qj = inst.src1 >= 0 ? regStatus[inst.src1] : -1;
+        int qk = inst.src2 >= 0 ? regStatus[inst.src2] : -1;
+        int address = inst.imm;
+        if (info.address == ADDR_BRANCH)
+            address = inst.pc + inst.imm + 1;
+        else if (info.address == ADDR_CALL) {
+            address = inst.pc + inst.imm;
+            val1 = pc;
+        }
+        rs[ind] = RSEntry(true, inst.opcode, val1, val2, qj, qk, rbInd, Cfg::latency[info.unit], address, j);
+        if (info.setsRegStatus)
+            regStatus[inst.dst] = ind;
+        if (inst.opcode == 't')
+            storeSlots[rbInd][0] = ADDRESS_UNKNOWN;
+        regStatus[0] = -1;
+        pc++;
+        dynamicCount++;
+    }
+
+    bool canLoad(int robId, int address, int& val, bool& other) const {
+        int index = robId;
+        while (index != head) {
+            index = (index - 1) & robMask;
+            if (storeSlots[index][0] == ADDRESS_UNKNOWN || storeSlots[index][0] == address) {
+                if (!storeSlots[index][1])
+                    return false;
+                val = storeSlots[index][2];
+                other = true;
+                return true;
+            }
+        }
+        return true;
+    }
+
+    void execute() {
+        for (auto& r : rs) {
+            if (!r.busy)
+                continue;
+            if (r.executionCyclesLeft > 0 && r.Qj == -1 && (r.Qk == -1 || r.Qk == -2)) {
+                recordExecStart(r.instId);
+                r.executionCyclesLeft--;
+            }
+            if (r.op == 'l' && r.executionCyclesLeft == 0 && r.Qk != -2) {
+                bool other = false;
+                int val;
+                if (!canLoad(r.robIndex, r.address + r.Vj, val, other))
+                    r.executionCyclesLeft = 1;
+                else if (other) {
+                    r.Vk = val;
+                    r.Qk = -2;
+                }
+                else {
+                    r.executionCyclesLeft = Cfg::readTime;
+                    r.Vk = readMemory(r.Vj + r.address);
+                    r.Qk = -2;
+                }
+            }
+            if (r.executionCyclesLeft == 0)
+                recordExecEnd(r.instId);
+        }
+    }
+
+    void writeBack() {
+        int index = -1, oldest = Cfg::robSize;
+        for (int i = 0; i < totalStations; i++)
+            if (rs[i].busy && rs[i].executionCyclesLeft == 0) {
+                int age = (rs[i].robIndex - head) & robMask;
+                if (age < oldest) {
+                    oldest = age;
+                    index = i;
+                }
+            }
+        if (index < 0)
+            return;
+
+        for (int i = 0; i < NUM_REGS; i++)
+            if (regStatus[i] == index) {
+                regStatus[i] = -1;
+                break;
+            }
+
+        RSEntry& e = rs[index];
+        int16_t value = -1;
+        switch (e.op) {
+        case 'l':
+            value = e.Vk;
+            break;
+        case 't':
+            value = e.Vj;
+            storeSlots[e.robIndex] = { e.address + e.Vk, 1, value };
+            entries[e.robIndex].destination = storeSlots[e.robIndex][0];
+            break;
+        case 'b':
+            value = (e.Vj == e.Vk);
+            entries[e.robIndex].destination = e.address;
+            break;
+        case 'c':
+            value = e.Vj + 1;
+            entries[e.robIndex].destination = e.address;
+            break;
+        case 'r':
+            entries[e.robIndex].destination = e.Vj;
+            break;
+        case 'a':
+            value = e.Vj + e.Vk;
+            break;
+        case 's':
+            value = e.Vj - e.Vk;
+            break;
+        case 'n':
+            value = ~(e.Vj & e.Vk);
+            break;
+        case 'm':
+            value = e.Vj * e.Vk;
+            break;
+        }
+        for (auto& r : rs) {
+            if (r.busy) {
+                if (r.Qj == index) {
+                    r.Qj = -1;
+                    r.Vj = value;
+                }
+                if (r.Qk == index && r.op != 'l') {
+                    r.Qk = -1;
+                    r.Vk = value;
+                }
+            }
+        }
+        entries[e.robIndex].ready = true;
+        entries[e.robIndex].value = value;
+        if (e.op != 't')
+            e.busy = false;
+        else {
+            e.Qj = index;
+            e.executionCyclesLeft = Cfg::latency[1];
+        }
+        recordWrite(e.instId);
+    }
+
+    void popHead() {
+        if (count == 0)
+            return;
+        entries[head].busy = false;
+        if (count == 1)
+            head = tail = 0;
+        else
+            head = (head + 1) & robMask;
+        count--;
+    }
+
+    void flush() {
+        for (auto& r : rs)
+            r.busy = false;
+        for (int i = 0; i < NUM_REGS; i++)
+            regStatus[i] = -1;
+        while (count > 1) {
+            count--;
+            tail = (tail - 1) & robMask;
+            entries[tail].busy = false;
+        }
+    }
+
+    void commit() {
+        int front = head;
+        storeCommit--;
+        if (count == 0 || !entries[front].ready || storeCommit > 0)
+            return;
+        int dest = entries[front].destination;
+        if (storeCommit == 0) {
+            for (auto& r : rs)
+                if (r.busy && r.robIndex == front)
+                    r.busy = false;
+            recordCommit(entries[front].instId);
+            popHead();
+            storeCommit--;
+            return;
+        }
+        storeCommit = -1;
+        char type = entries[front].type;
+        int16_t value = entries[front].value;
+        switch (type) {
+        case 't':
+            writeMemory(dest, value);
+            storeCommit = Cfg::writeTime - 1;
+            break;
+        case 'b':
+            branches++;
+            if (value) {
+                pc = dest;
+                flush();
+                mispred++;
+            }
+            break;
+        case 'c':
+            pc = dest;
+            registers[1] = value;
+            flush();
+            break;
+        case 'r':
+            pc = dest;
+            flush();
+            break;
+        default:
+            registers[dest] = value;
+        }
+        registers[0] = 0;
+        if (type != 't') {
+            recordCommit(entries[front].instId);
+            popHead();
+        }
+    }
+
+public:
+    FixedCore() {
+        for (auto& r : rs)
+            r.busy = false;
+    }
+
+    void run() {
+        while (count > 0 || pc < (int)programMemory.size()) {
+            commit();
+            writeBack();
+            execute();
+            if (pc < (int)programMemory.size())
+                issue(programMemory[pc]);
+            cycle++;
+        }
+    }
+};
+
+template<class Cfg>
+bool matchesConfig() {
+    if (ROBSize != Cfg::robSize || ReadMemoryTime != Cfg::readTime || WriteMemoryTime != Cfg::writeTime)
+        return false;
+    for (int u = 0; u < 7; u++)
+        if (reserve_num[u] != Cfg::stations[u] || cycles_num[u] != Cfg::latency[u])
+            return false;
+    return true;
+}
+
+template<class Cfg>
+bool tryFixedCore() {
+    if (!matchesConfig<Cfg>())
+        return false;
+    FixedCore<Cfg> core;
+    core.run();
+    return true;
+}
+
+#endif
+
+// Runs the program on a fixed-configuration core if one matches; every extra feature needs
+// the generic path
+bool runFixedCore() {
+#ifndef NO_FIXED_CORES
+    if (numCores > 1 || smtThreads > 1 || useStoreSets || useFrontEnd || useJournal || useIntervalStats || useIdiomElimination || useEnergy || usePrefetcher || traceMode != TRACE_OFF || useProfile || useCriticalPath || useValuePrediction)
+        return false;
+    return tryFixedCore<DefaultConfig>() || tryFixedCore<LargeConfig>();
+#else
+    return false;
+#endif
+}
+
+
+// Result cache
+// A run is identified by its program, its initial memory and every setting that changes what it
+// prints. Runs with the debug journal, interval statistics or a replayed trace depend on or
+// produce more than the printed results, so they are not offered the cache.
+
+string runIdentity() {
+    ostringstream id;
+    id << setprecision(17);
+    id << "program " << hex << programHash() << dec << " " << programMemory.size() << " at " << pcStart
+        << "\nmemory " << hex << memoryImage->hash() << dec
+        << "\nrob " << ROBSize << " read " << ReadMemoryTime << " write " << WriteMemoryTime << "\nstations";
+    for (int u = 0; u < 7; u++)
+        id << " " << reserve_num[u] << "x" << cycles_num[u];
+    id << "\nstore sets " << useStoreSets << ", idiom elimination " << useIdiomElimination;
+    id << "\nfront end " << useFrontEnd;
+    if (useFrontEnd)
+        id << " " << fetchWidth << " " << fetchQueueSize << " " << frontEndDepth << " " << ICacheLines << " "
+            << ICacheLineSize << " " << ICacheMissTime;
+    id << "\nenergy " << useEnergy;
+    if (useEnergy) {
+        for (int e = 0; e < NUM_ENERGY_EVENTS; e++)
+            id << " " << energyParams.event[e];
+        id << " " << energyParams.baseLeakage << " " << energyParams.robEntryLeakage << " " << energyParams.rsEntryLeakage
+            << " " << energyParams.clockGHz;
+    }
+    id << "\nprefetcher " << usePrefetcher;
+    if (usePrefetcher)
+        id << " " << prefetchTableSize << " " << prefetchDistance << " " << prefetchBufferSize << " " << PrefetchHitTime;
+    id << "\nvalue prediction " << useValuePrediction;
+    if (useValuePrediction)
+        id << " " << valueTableSize << " " << valueConfidence;
+    id << "\ntrace " << traceMode << (traceMode == TRACE_RECORD ? " " + tracePath : string());
+    id << "\nprofile " << useProfile << ", critical path " << useCriticalPath << "\n";
+    return id.str();
+}
+
+// Prints the results of an identical earlier run and restores its trace; false if there are none
+bool printCachedResults() {
+    string error = resultCache.open(cacheDir, cacheMaxMB * 1048576LL);
+    if (!error.empty()) {
+        cout << error << ", the results will not be cached\n";
+        useResultCache = false;
+        return false;
+    }
+    cacheIdentity = runIdentity();
+    cacheKey = 14695981039346656037ull;
+    for (unsigned char ch : cacheIdentity)
+        cacheKey = (cacheKey ^ ch) * 1099511628211ull;
+    string results, trace;
+    if (!resultCache.lookup(cacheKey, cacheIdentity, results, trace))
+        return false;
+    if (traceMode == TRACE_RECORD && !trace.empty()) {
+        ofstream out(tracePath, ios::binary | ios::trunc);
+        out.write(trace.data(), trace.size());
+        if (!out)
+            cout << "Could not write " << tracePath << "\n";
+    }
+    cout << results;
+    cout << "These results were taken from the result cache (" << resultCache.file << ")\n";
+    return true;
+}
+
+// Prints the results and keeps them, with the recorded trace, for identical runs
+void cacheResults() {
+    ostringstream results;
+    printResults(results);
+    cout << results.str();
+    string trace;
+    if (traceMode == TRACE_RECORD && traceWriter.bytes > 0) {
+        ifstream in(tracePath, ios::binary);
+        trace.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    if (!resultCache.store(cacheKey, cacheIdentity, results.str(), trace))
+        cout << "Could not write " << resultCache.file << ", the results were not cached\n";
+    else if (resultCache.evicted > 0)
+        cout << "The results were cached, " << resultCache.evicted << " least recently used entries were evicted\n";
 }
 
 
 // Phase 7: Simulator Loop
 
+bool coreDone() {
+    if (!rob.isEmpty())
+        return false;
+    for (int t = 0; t < smtThreads; t++)
+        if (threadFetching(t))
+            return false;
+    return true;
+}
+
+void stepCycle() {
+    if (useProfile)
+        profileCycle();
+    if (useStoreSets)
+        storeSets.tick(cycle);
+    commitInstruction();
+    writeBackResults();
+    decrementExecutionTimers();
+    if (smtThreads > 1)
+        issueSMT();
+    else if (useFrontEnd) {
+        issueFromFetchQueue();
+        fetchInstructions();
+    }
+    else if (pc < (int)programMemory.size())
+        issueInstruction(programMemory[pc]);
+    cycle++;
+    if (useJournal)
+        journal.record();
+    if (useIntervalStats)
+        sampleCycle();
+}
+
 void runSimulator() {
-    while (!rob.isEmpty() || pc<programMemory.size()) {
-        commitInstruction();
-        writeBackResults();
-        decrementExecutionTimers();
-        if (pc<programMemory.size())
-            issueInstruction(programMemory[pc]);
-        cycle++;
+    if (traceMode != TRACE_OFF && !startTrace())
+        return;
+    if (useProfile)
+        startProfile();
+    if (useCriticalPath)
+        startCriticalPath();
+    if (useJournal)
+        journal.start();
+    if (useIntervalStats)
+        startIntervalStats();
+    if (!runFixedCore())
+        while (!coreDone())
+            stepCycle();
+    if (useIntervalStats)
+        finishIntervalStats();
+    if (traceMode == TRACE_RECORD)
+        traceWriter.close();
+
+    if (useResultCache)
+        cacheResults();
+    else
+        printResults();
+    if (useJournal)
+        runDebugger();
+}
+
+
+// Phase 8: Multi-core
+
+// Reusable barrier for the cores' host threads
+class QuantumBarrier {
+    mutex m;
+    condition_variable cv;
+    int waiting = 0;
+    int generation = 0;
+
+public:
+    void wait() {
+        unique_lock<mutex> lock(m);
+        int gen = generation;
+        if (++waiting == numCores) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        }
+        else
+            cv.wait(lock, [&] { return gen != generation; });
+    }
+};
+
+QuantumBarrier quantumBarrier;
+
+// Runs between two barriers on core 0's thread only: publishes every core's writes in core order,
+// so the final memory image only depends on the quantum, not on host thread scheduling
+void endQuantum() {
+    for (int c = 0; c < numCores; c++) {
+        for (auto& w : cores[c].writes) {
+            dataMemory.write(w.first, w.second);
+            for (int o = 0; o < numCores; o++)
+                if (o != c && cores[o].cached.erase(w.first)) {
+                    cores[o].invalid.insert(w.first);
+                    cores[o].invalidations++;
+                }
+        }
+        cores[c].writes.clear();
+    }
+    allCoresDone = true;
+    for (int c = 0; c < numCores; c++)
+        if (!cores[c].done)
+            allCoresDone = false;
+}
+
+void runCore(int id, CoreConfig config) {
+    applyConfig(config);
+    coreId = id;
+    programMemory = cores[id].program;
+    pcStart = cores[id].pcStart;
+    initRegisters();
+    initReservationStations();
+    if (useFrontEnd)
+        initFrontEnd();
+    if (useIntervalStats)
+        startIntervalStats();
+    while (true) {
+        for (int q = 0; q < quantum && !coreDone(); q++)
+            stepCycle();
+        cores[id].done = coreDone();
+        quantumBarrier.wait();
+        if (id == 0)
+            endQuantum();
+        quantumBarrier.wait();
+        if (allCoresDone)
+            break;
+    }
+    if (useIntervalStats)
+        finishIntervalStats();
+    ostringstream out;
+    printResults(out);
+    cores[id].output = out.str();
+}
+
+void runMultiCore() {
+    cores.resize(numCores);
+    for (int c = 0; c < numCores; c++) {
+        cout << "Program for core " << c << ":\n";
+        loadProgram();
+        cores[c].program = programMemory;
+        cores[c].pcStart = pcStart;
+    }
+    initMemory();
+
+    vector<thread> threads;
+    for (int c = 0; c < numCores; c++)
+        threads.emplace_back(runCore, c, currentConfig());
+    for (auto& t : threads)
+        t.join();
+
+    for (int c = 0; c < numCores; c++)
+        cout << "\nCore " << c << ":\n" << cores[c].output;
+}
+
+
+// Phase 9: Design-space search
+// Looks for the cheapest core (ROB entries, stations per unit and, if asked, unit latencies) that
+// reaches an IPC or total-cycle target over a set of workloads. The cost of a core is a weighted
+// sum of its ROB entries and stations plus, per unit, speedCost / latency. Every run of one
+// candidate on one workload gets a fresh host thread, so its thread_local core starts clean, and
+// a copy-on-write copy of the workload's memory image; searchThreads runs go at once. A run stops
+// early once its IPC so far falls below pruneFraction of the target, or at the cycle limit.
+
+struct Workload {
+    vector<Instruction> program;
+    int pcStart = 0;
+    PagedMemory memory;
+};
+
+struct Candidate {
+    CoreConfig config;
+    double cost = 0;
+    bool evaluated = false;
+    bool complete = false;          // every workload ran to the end
+    bool pruned = false;            // a run fell below the IPC floor
+    long long budget = 0;           // cycle budget per workload of the last evaluation
+    long long cycles = 0;           // over all workloads, up to where the runs stopped
+    long long committed = 0;
+
+    double ipc() const {
+        return cycles > 0 ? static_cast<double>(committed) / cycles : 0.0;
+    }
+};
+
+struct SearchSettings {
+    double targetIpc = 1.0;
+    double robEntryCost = 1.0;
+    double stationCost[7] = { 2, 2, 1, 1, 1.5, 1, 3 };
+    double speedCost[7] = { 4, 4, 4, 4, 4, 4, 4 };
+    bool searchLatencies = false;
+    int maxROB = 32;
+    int maxStations = 8;
+    array<int, 7> maxLatency;       // the starting latencies; the search only makes units faster
+    long long cycleLimit = 1000000;
+    double pruneFraction = 0.5;
+    int threads = 1;
+};
+
+const int PRUNE_INTERVAL = 1000;    // cycles between checks of a run's IPC
+
+SearchSettings searchSettings;
+vector<Workload> workloads;
+map<vector<int>, Candidate> candidates;
+long long searchRuns = 0;
+long long prunedRuns = 0;
+
+double configCost(const CoreConfig& c) {
+    double cost = searchSettings.robEntryCost * c.robSize;
+    for (int u = 0; u < 7; u++) {
+        cost += searchSettings.stationCost[u] * c.reserveNum[u];
+        cost += searchSettings.speedCost[u] / c.cyclesNum[u];
+    }
+    return cost;
+}
+
+Candidate& candidateFor(const CoreConfig& c) {
+    vector<int> key{ c.robSize };
+    key.insert(key.end(), c.reserveNum.begin(), c.reserveNum.end());
+    key.insert(key.end(), c.cyclesNum.begin(), c.cyclesNum.end());
+    Candidate& cand = candidates[key];
+    if (!cand.evaluated) {
+        cand.config = c;
+        cand.cost = configCost(c);
+    }
+    return cand;
+}
+
+// Runs one workload to the end, to the cycle budget or until its IPC falls below pruneIpc;
+// must be called on a fresh thread. Returns true if the run was pruned.
+bool runWorkload(const CoreConfig& c, const Workload& w, long long budget, double pruneIpc,
+    long long& cycles, long long& committed, bool& complete) {
+    applyConfig(c);
+    programMemory = w.program;
+    pcStart = w.pcStart;
+    PagedMemory image = w.memory;
+    memoryImage = &image;
+    initRegisters();
+    initReservationStations();
+    if (useFrontEnd)
+        initFrontEnd();
+    bool pruned = false;
+    while (!coreDone() && cycle < budget) {
+        stepCycle();
+        if (cycle % PRUNE_INTERVAL == 0 && contexts[0].committed < pruneIpc * cycle) {
+            pruned = true;
+            break;
+        }
+    }
+    complete = coreDone();
+    cycles = complete ? cycle - 1 : cycle;
+    committed = contexts[0].committed;
+    memoryImage = &dataMemory;
+    return pruned;
+}
+
+// Calls job(0) .. job(count - 1), each on a new host thread so that it starts with clean
+// thread_local state, with at most threads of them running at once
+void runOnFreshThreads(size_t count, int threads, const function<void(size_t)>& job) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            thread t(job, i);
+            t.join();
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+}
+
+// Runs the loaded program once without value prediction, on a fresh thread, for the net gain in
+// the results; the features that only observe the run are off for it
+void measurePredictionBaseline() {
+    Workload w{ programMemory, pcStart, *memoryImage };
+    CoreConfig c = currentConfig();
+    bool journal = useJournal, stats = useIntervalStats, prof = useProfile, path = useCriticalPath;
+    int mode = traceMode;
+    useValuePrediction = useJournal = useIntervalStats = useProfile = useCriticalPath = false;
+    traceMode = TRACE_OFF;
+    runOnFreshThreads(1, 1, [&](size_t) {
+        long long committed;
+        bool complete;
+        runWorkload(c, w, INT64_MAX, 0.0, predictionBaseline, committed, complete);
+    });
+    useValuePrediction = true;
+    useJournal = journal;
+    useIntervalStats = stats;
+    useProfile = prof;
+    useCriticalPath = path;
+    traceMode = mode;
+}
+
+// Runs the candidates that still need it on every workload, searchThreads runs at a time
+void evaluate(const vector<Candidate*>& batch, long long budget, double pruneIpc) {
+    struct Run {
+        Candidate* cand;
+        int workload;
+        long long cycles = 0, committed = 0;
+        bool complete = false, pruned = false;
+    };
+    vector<Run> runs;
+    unordered_set<Candidate*> queued;
+    for (Candidate* c : batch) {
+        bool needed = !c->evaluated || (!c->complete && !c->pruned && c->budget < budget);
+        if (!needed || !queued.insert(c).second)
+            continue;
+        for (int w = 0; w < (int)workloads.size(); w++)
+            runs.push_back({ c, w });
+    }
+
+    runOnFreshThreads(runs.size(), searchSettings.threads, [&](size_t i) {
+        Run& r = runs[i];
+        r.pruned = runWorkload(r.cand->config, workloads[r.workload], budget, pruneIpc, r.cycles, r.committed, r.complete);
+    });
+
+    for (size_t i = 0; i < runs.size(); i++) {
+        Candidate* c = runs[i].cand;
+        if (runs[i].workload == 0) {
+            c->evaluated = true;
+            c->complete = true;
+            c->pruned = false;
+            c->budget = budget;
+            c->cycles = c->committed = 0;
+        }
+        c->complete = c->complete && runs[i].complete;
+        c->pruned = c->pruned || runs[i].pruned;
+        c->cycles += runs[i].cycles;
+        c->committed += runs[i].committed;
+        searchRuns++;
+        prunedRuns += runs[i].pruned;
+    }
+}
+
+bool meetsTarget(const Candidate& c) {
+    return c.complete && c.ipc() >= searchSettings.targetIpc;
+}
+
+// Lower is better: the cost, plus a penalty larger than any cost difference for missing the
+// target. With partial true, runs cut by the cycle budget are judged by their IPC so far.
+double score(const Candidate& c, bool partial = false) {
+    static const double PENALTY = 1e6;
+    double shortfall = max(0.0, (searchSettings.targetIpc - c.ipc()) / searchSettings.targetIpc);
+    if (!c.complete && (c.pruned || !partial))
+        shortfall = max(shortfall, 0.01);
+    return c.cost + PENALTY * shortfall;
+}
+
+vector<CoreConfig> neighbors(const CoreConfig& c) {
+    vector<CoreConfig> result;
+    for (int d : { -2, 2 }) {
+        CoreConfig n = c;
+        n.robSize += d;
+        if (n.robSize >= 2 && n.robSize <= searchSettings.maxROB)
+            result.push_back(n);
     }
+    for (int u = 0; u < 7; u++)
+        for (int d : { -1, 1 }) {
+            CoreConfig n = c;
+            n.reserveNum[u] += d;
+            if (n.reserveNum[u] >= 1 && n.reserveNum[u] <= searchSettings.maxStations)
+                result.push_back(n);
+            if (!searchSettings.searchLatencies)
+                continue;
+            n = c;
+            n.cyclesNum[u] += d;
+            if (n.cyclesNum[u] >= 1 && n.cyclesNum[u] <= searchSettings.maxLatency[u])
+                result.push_back(n);
+        }
+    return result;
+}
 
-    printResults();
+CoreConfig randomConfig(mt19937& rng) {
+    CoreConfig c;
+    c.robSize = 2 * uniform_int_distribution<int>(1, searchSettings.maxROB / 2)(rng);
+    for (int u = 0; u < 7; u++) {
+        c.reserveNum[u] = uniform_int_distribution<int>(1, searchSettings.maxStations)(rng);
+        c.cyclesNum[u] = searchSettings.searchLatencies
+            ? uniform_int_distribution<int>(1, searchSettings.maxLatency[u])(rng) : searchSettings.maxLatency[u];
+    }
+    return c;
+}
+
+// Steepest descent: move to the best neighbor while it improves the score
+void hillClimb(Candidate* current, int iterations) {
+    for (int it = 0; it < iterations; it++) {
+        vector<Candidate*> batch;
+        for (auto& n : neighbors(current->config))
+            batch.push_back(&candidateFor(n));
+        evaluate(batch, searchSettings.cycleLimit, searchSettings.pruneFraction * searchSettings.targetIpc);
+        Candidate* best = current;
+        for (Candidate* c : batch)
+            if (score(*c) < score(*best))
+                best = c;
+        if (best == current)
+            break;
+        current = best;
+    }
+}
+
+// Each step evaluates one random neighbor per thread and proposes the best of them; a worse
+// proposal is accepted with probability exp(-delta / T), T falling geometrically to 1% of T0
+void anneal(Candidate* current, int iterations, mt19937& rng) {
+    double temperature = 0.1 * current->cost;
+    double cooling = pow(0.01, 1.0 / max(iterations, 1));
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int it = 0; it < iterations; it++, temperature *= cooling) {
+        vector<CoreConfig> options = neighbors(current->config);
+        if (options.empty())
+            break;
+        vector<Candidate*> batch;
+        for (int t = 0; t < searchSettings.threads; t++)
+            batch.push_back(&candidateFor(options[uniform_int_distribution<int>(0, options.size() - 1)(rng)]));
+        evaluate(batch, searchSettings.cycleLimit, searchSettings.pruneFraction * searchSettings.targetIpc);
+        Candidate* proposal = batch[0];
+        for (Candidate* c : batch)
+            if (score(*c) < score(*proposal))
+                proposal = c;
+        double delta = score(*proposal) - score(*current);
+        if (delta < 0 || uniform(rng) < exp(-delta / temperature))
+            current = proposal;
+    }
+}
+
+// Runs n random candidates with a small cycle budget, keeps the better half by their IPC so
+// far and doubles the budget, until one candidate is left or the budget reaches the limit
+void successiveHalving(Candidate* start, int n, mt19937& rng) {
+    vector<Candidate*> population{ start };
+    for (int tries = 0; (int)population.size() < n && tries < 100 * n; tries++) {
+        Candidate* c = &candidateFor(randomConfig(rng));
+        if (find(population.begin(), population.end(), c) == population.end())
+            population.push_back(c);
+    }
+    int rounds = 1;
+    while ((1 << (rounds - 1)) < (int)population.size())
+        rounds++;
+    long long budget = max<long long>(PRUNE_INTERVAL, searchSettings.cycleLimit >> (rounds - 1));
+    while (true) {
+        evaluate(population, budget, searchSettings.pruneFraction * searchSettings.targetIpc);
+        if (population.size() == 1 || budget >= searchSettings.cycleLimit)
+            break;
+        sort(population.begin(), population.end(), [](Candidate* a, Candidate* b) {
+            return score(*a, true) < score(*b, true);
+        });
+        population.resize((population.size() + 1) / 2);
+        budget = min(2 * budget, searchSettings.cycleLimit);
+    }
+}
+
+string describe(const CoreConfig& c) {
+    ostringstream out;
+    out << "ROB " << c.robSize << ", stations";
+    for (int n : c.reserveNum)
+        out << " " << n;
+    out << ", latencies";
+    for (int n : c.cyclesNum)
+        out << " " << n;
+    return out.str();
+}
+
+void printSearchResults() {
+    vector<Candidate*> done;
+    for (auto& entry : candidates)
+        if (entry.second.complete)
+            done.push_back(&entry.second);
+    sort(done.begin(), done.end(), [](Candidate* a, Candidate* b) {
+        return a->cost != b->cost ? a->cost < b->cost : a->ipc() > b->ipc();
+    });
+    cout << "\nDesign-space search: " << candidates.size() << " configurations, " << searchRuns << " runs, "
+        << prunedRuns << " of them stopped early\n";
+    cout << "Pareto frontier of cost vs IPC (stations and latencies in the order load, store, beq, call/ret, add/sub, nand, mul):\n";
+    double bestIpc = -1;
+    Candidate* cheapest = nullptr;
+    for (Candidate* c : done) {
+        if (!cheapest && meetsTarget(*c))
+            cheapest = c;
+        if (c->ipc() <= bestIpc)
+            continue;
+        bestIpc = c->ipc();
+        cout << "   cost " << c->cost << ", IPC " << c->ipc() << ", " << c->cycles << " cycles"
+            << (meetsTarget(*c) ? " (meets the target)" : "") << ": " << describe(c->config) << "\n";
+    }
+    if (cheapest)
+        cout << "Cheapest configuration meeting the target: " << describe(cheapest->config) << " (cost " << cheapest->cost << ")\n";
+    else
+        cout << "No configuration that was tried meets the target\n";
+}
+
+void runDesignSearch() {
+    int n;
+    cout << "Enter the number of workloads: ";
+    cin >> n;
+    workloads.resize(max(n, 1));
+    for (int w = 0; w < (int)workloads.size(); w++) {
+        cout << "Workload " << w << ":\n";
+        loadProgram();
+        workloads[w].program = programMemory;
+        workloads[w].pcStart = pcStart;
+        memoryImage = &workloads[w].memory;
+        initMemory();
+    }
+    memoryImage = &dataMemory;
+
+    int ans;
+    cout << "Is the target an IPC (press 0) or a total number of cycles over all workloads (press 1)? ";
+    cin >> ans;
+    double target;
+    cout << "Enter the target: ";
+    cin >> target;
+    cout << "Do you want the search to also make the units faster (change their latencies)? press 1, otherwise press 0\n";
+    cin >> searchSettings.searchLatencies;
+    cout << "Do you want to use the default hardware costs? press 1, otherwise press 0 to enter them\n";
+    int defaults;
+    cin >> defaults;
+    if (!defaults) {
+        cout << "Enter the cost of one ROB entry: ";
+        cin >> searchSettings.robEntryCost;
+        for (int u = 0; u < 7; u++) {
+            cout << "Enter the cost of one " << unitNames[u] << " reservation station: ";
+            cin >> searchSettings.stationCost[u];
+            if (searchSettings.searchLatencies) {
+                cout << "Enter the speed cost of the " << unitNames[u] << " unit (its cost is this divided by its latency): ";
+                cin >> searchSettings.speedCost[u];
+            }
+        }
+    }
+    cout << "Enter the largest ROB size to consider: ";
+    cin >> searchSettings.maxROB;
+    cout << "Enter the largest number of reservation stations per unit to consider: ";
+    cin >> searchSettings.maxStations;
+    cout << "Enter the cycle limit for one run of a workload: ";
+    cin >> searchSettings.cycleLimit;
+    cout << "Stop a run early when its IPC falls below what fraction of the target? (0 to never stop early): ";
+    cin >> searchSettings.pruneFraction;
+    cout << "Enter the number of runs to simulate at once (0 for one per host core): ";
+    cin >> searchSettings.threads;
+    if (searchSettings.threads <= 0)
+        searchSettings.threads = max(1u, thread::hardware_concurrency());
+    int strategy, steps;
+    cout << "Choose the search: 0) hill climbing 1) simulated annealing 2) successive halving\n";
+    cin >> strategy;
+    cout << (strategy == 2 ? "Enter the number of random configurations to start from: " : "Enter the maximum number of steps: ");
+    cin >> steps;
+
+    // The starting configuration runs in full first; it gives the instruction count that turns
+    // a cycle target into an IPC target (the committed instructions do not depend on the core)
+    CoreConfig start = currentConfig();
+    start.robSize = max(2, min(start.robSize, searchSettings.maxROB));
+    for (int u = 0; u < 7; u++)
+        start.reserveNum[u] = max(1, min(start.reserveNum[u], searchSettings.maxStations));
+    copy(cycles_num, cycles_num + 7, searchSettings.maxLatency.begin());
+    Candidate* first = &candidateFor(start);
+    searchSettings.targetIpc = 0;
+    evaluate({ first }, searchSettings.cycleLimit, 0.0);
+    if (!first->complete) {
+        cout << "The workloads do not finish within " << searchSettings.cycleLimit << " cycles on the starting configuration\n";
+        return;
+    }
+    searchSettings.targetIpc = ans ? first->committed / target : target;
+    cout << "Starting configuration: " << describe(start) << ", cost " << first->cost << ", IPC " << first->ipc() << "\n";
+
+    mt19937 rng(1);
+    if (strategy == 0)
+        hillClimb(first, steps);
+    else if (strategy == 1)
+        anneal(first, steps, rng);
+    else
+        successiveHalving(first, steps, rng);
+    printSearchResults();
+}
+
+
+// Phase 10: Batched functional execution
+// Runs one program over many data memory images in lockstep, without timing. The registers are
+// kept lane-major (regs[r][lane]) so the ALU instructions are loops over the lanes with a blend
+// on the lane mask, which the compiler turns into vector instructions. The lanes are split into
+// blocks of LANE_BLOCK that run on their own (and on separate threads). Every lane has its own pc:
+// each step of a block runs the instruction at the smallest pc of its running lanes for the lanes
+// that are at that pc, so lanes that took different BEQ outcomes run again together from the first
+// pc they share. Each lane also hashes its stream of pcs and load/store addresses; the timing of a
+// run only depends on that stream, so the timing model runs once per distinct stream. Value
+// prediction would make it depend on the loaded values too, so it is not offered with batches.
+
+const int LANE_BLOCK = 64;
+
+struct LaneBatch {
+    int lanes;                              // rounded up to whole blocks; the extra lanes never run
+    vector<int16_t> regs[NUM_REGS];         // regs[r][lane]
+    vector<int> pc;
+    vector<PagedMemory> memory;
+    vector<long long> executed;
+    vector<uint64_t> signature;
+
+    LaneBatch(int n, const PagedMemory& image)
+        : lanes((n + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK), pc(lanes, -1), memory(n, image), executed(lanes, 0), signature(lanes, 14695981039346656037ull) {
+        for (auto& r : regs)
+            r.assign(lanes, 0);
+        fill(pc.begin(), pc.begin() + n, 0);
+    }
+};
+
+inline void mixSignature(uint64_t& sig, uint64_t value) {
+    sig = (sig ^ value) * 1099511628211ull;
+}
+
+// Runs the lanes of one block until each pc leaves the program or has executed limit instructions
+void runLanes(LaneBatch& b, int block, const vector<Instruction>& program, long long limit) {
+    const int n = LANE_BLOCK;
+    const int first = block * LANE_BLOCK;
+    const unsigned size = program.size();
+    int* lanePc = b.pc.data() + first;
+    long long* executed = b.executed.data() + first;
+    uint64_t* signature = b.signature.data() + first;
+    PagedMemory* memory = b.memory.data() + first;
+    // Lane masks (-1 for the lanes running the current instruction) and ALU results are local
+    // arrays, so the compiler knows they do not overlap the registers and vectorizes the loops
+    int16_t m[LANE_BLOCK];
+    int active[LANE_BLOCK];
+    int16_t result[LANE_BLOCK];
+    for (long long step = 1;; step++) {
+        unsigned cur = UINT32_MAX;          // stopped lanes have pc -1, so the unsigned minimum skips them
+        for (int l = 0; l < n; l++)
+            cur = min(cur, (unsigned)lanePc[l]);
+        if (cur >= size)
+            break;
+        const Instruction& inst = program[cur];
+        for (int l = 0; l < n; l++) {
+            active[l] = lanePc[l] == (int)cur ? -1 : 0;
+            m[l] = (int16_t)active[l];
+        }
+        for (int l = 0; l < n; l++)
+            executed[l] += active[l] & 1;
+
+        int next = cur + 1;
+        int16_t* d = inst.dst > 0 ? b.regs[inst.dst].data() + first : nullptr;     // writes to R0 are dropped
+        const int16_t* x = inst.src1 >= 0 ? b.regs[inst.src1].data() + first : nullptr;
+        const int16_t* y = inst.src2 >= 0 ? b.regs[inst.src2].data() + first : nullptr;
+        bool alu = false, control = false;
+        switch (inst.opcode) {
+        case 'a':
+            for (int l = 0; l < n; l++)
+                result[l] = (int16_t)(x[l] + y[l]);
+            alu = true;
+            break;
+        case 's':
+            for (int l = 0; l < n; l++)
+                result[l] = (int16_t)(x[l] - y[l]);
+            alu = true;
+            break;
+        case 'n':
+            for (int l = 0; l < n; l++)
+                result[l] = (int16_t)~(x[l] & y[l]);
+            alu = true;
+            break;
+        case 'm':
+            for (int l = 0; l < n; l++)
+                result[l] = (int16_t)(x[l] * y[l]);
+            alu = true;
+            break;
+        case 'l':
+            for (int l = 0; l < n; l++)
+                if (m[l]) {
+                    int address = inst.imm + x[l];
+                    mixSignature(signature[l], (uint32_t)address);
+                    int16_t value = memory[l].read(address);
+                    if (d)
+                        d[l] = value;
+                }
+            break;
+        case 't':
+            for (int l = 0; l < n; l++)
+                if (m[l]) {
+                    int address = inst.imm + y[l];
+                    mixSignature(signature[l], (uint32_t)address);
+                    memory[l].write(address, x[l]);
+                }
+            break;
+        case 'b': {
+            int target = inst.pc + inst.imm + 1;
+            for (int l = 0; l < n; l++) {
+                int taken = x[l] == y[l] ? -1 : 0;
+                lanePc[l] = (((target & taken) | (next & ~taken)) & active[l]) | (lanePc[l] & ~active[l]);
+            }
+            control = true;
+            break;
+        }
+        case 'c':
+            if (inst.dst > 0)
+                for (int l = 0; l < n; l++)
+                    d[l] = (int16_t)((next & m[l]) | (d[l] & ~m[l]));
+            for (int l = 0; l < n; l++)
+                lanePc[l] = ((inst.pc + inst.imm) & active[l]) | (lanePc[l] & ~active[l]);
+            control = true;
+            break;
+        case 'r':
+            for (int l = 0; l < n; l++)
+                lanePc[l] = (x[l] & active[l]) | (lanePc[l] & ~active[l]);
+            control = true;
+            break;
+        }
+        if (alu && d)
+            for (int l = 0; l < n; l++)
+                d[l] = (int16_t)((result[l] & m[l]) | (d[l] & ~m[l]));
+        // Between control instructions the pcs follow from the start, so the stream hash only
+        // needs the control outcomes and the addresses
+        if (control) {
+            for (int l = 0; l < n; l++)
+                if (m[l])
+                    mixSignature(signature[l], (uint32_t)lanePc[l]);
+        }
+        else
+            for (int l = 0; l < n; l++)
+                lanePc[l] += active[l] & 1;
+        if (step >= limit)                  // a lane runs at most one instruction per step
+            for (int l = 0; l < n; l++)
+                if (executed[l] >= limit)
+                    lanePc[l] = -1;
+    }
+}
+
+// One data set per line: "address value" pairs applied on top of the memory entered with initMemory()
+bool readDataSets(const string& path, vector<vector<pair<int, int16_t>>>& sets) {
+    ifstream in(path);
+    if (!in)
+        return false;
+    string line;
+    while (getline(in, line)) {
+        line = stripComment(line);
+        trim(line);
+        if (line.empty())
+            continue;
+        istringstream fields(line);
+        vector<pair<int, int16_t>> set;
+        int address, value;
+        while (fields >> address >> value)
+            set.push_back({ address, (int16_t)value });
+        sets.push_back(set);
+    }
+    return true;
+}
+
+void runBatch() {
+    loadProgram();
+    initMemory();
+    string path;
+    cout << "Enter the file with the input data sets (one per line, as address value pairs): ";
+    cin >> path;
+    vector<vector<pair<int, int16_t>>> sets;
+    if (!readDataSets(path, sets) || sets.empty()) {
+        cout << "Could not read any data set from " << path << "\n";
+        return;
+    }
+    long long limit;
+    cout << "Enter the maximum number of instructions per data set: ";
+    cin >> limit;
+    int timingRuns;
+    cout << "Do you want to run the timing model for every distinct instruction stream? press 1, otherwise press 0\n";
+    cin >> timingRuns;
+    int threads = max(1u, thread::hardware_concurrency());
+
+    int n = sets.size();
+    LaneBatch batch(n, dataMemory);
+    for (int l = 0; l < n; l++)
+        for (auto& w : sets[l])
+            batch.memory[l].write(w.first, w.second);
+    auto begin = chrono::steady_clock::now();
+    int blocks = batch.lanes / LANE_BLOCK;
+    const vector<Instruction>& program = programMemory;
+    runOnFreshThreads(blocks, threads, [&](size_t block) {
+        runLanes(batch, block, program, limit);
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    // Data sets with the same stream get the timing of its first data set
+    map<uint64_t, int> streamOf;
+    vector<int> stream(n);
+    vector<int> representative;
+    for (int l = 0; l < n; l++) {
+        auto it = streamOf.find(batch.signature[l]);
+        if (it == streamOf.end()) {
+            it = streamOf.insert({ batch.signature[l], (int)representative.size() }).first;
+            representative.push_back(l);
+        }
+        stream[l] = it->second;
+    }
+    vector<long long> cycles(representative.size(), -1);
+    if (timingRuns) {
+        CoreConfig config = currentConfig();
+        Workload base;                          // programMemory and pcStart are thread_local, so copy them here
+        base.program = programMemory;
+        base.pcStart = pcStart;
+        base.memory = dataMemory;
+        runOnFreshThreads(representative.size(), threads, [&](size_t s) {
+            Workload w = base;
+            for (auto& write : sets[representative[s]])
+                w.memory.write(write.first, write.second);
+            long long committed;
+            bool complete;
+            runWorkload(config, w, limit * 100, 0.0, cycles[s], committed, complete);
+            if (!complete)
+                cycles[s] = -1;
+        });
+    }
+
+    cout << "data set: instructions, stream";
+    if (timingRuns)
+        cout << ", cycles, IPC";
+    cout << ", registers R1-R7\n";
+    for (int l = 0; l < n; l++) {
+        cout << l << ": " << batch.executed[l] << ", " << stream[l];
+        if (timingRuns) {
+            long long c = cycles[stream[l]];
+            if (c > 0)
+                cout << ", " << c << ", " << static_cast<double>(batch.executed[l]) / c;
+            else
+                cout << ", -, -";
+        }
+        cout << ",";
+        for (int r = 1; r < NUM_REGS; r++)
+            cout << " " << batch.regs[r][l];
+        cout << "\n";
+    }
+    cout << "\n" << n << " data sets ran in " << seconds << " s (" << (seconds > 0 ? n / seconds : 0.0)
+        << " data sets/s), " << representative.size() << " distinct instruction streams\n";
 }
 
 
@@ -909,10 +3726,33 @@ void runSimulator() {
 
 int main() {
     chooseVariables();
-    loadProgram();
+    chooseFeatures();
+    if (useSearch) {
+        runDesignSearch();
+        return 0;
+    }
+    if (useBatch) {
+        runBatch();
+        return 0;
+    }
+    if (numCores > 1) {
+        runMultiCore();
+        return 0;
+    }
+    if (smtThreads > 1)
+        loadThreads();
+    else
+        loadProgram();
     initRegisters();
-    initMemory();
+    if (traceMode != TRACE_REPLAY)
+        initMemory();
     initReservationStations();
+    if (useFrontEnd)
+        initFrontEnd();
+    if (useResultCache && printCachedResults())
+        return 0;
+    if (useValuePrediction)
+        measurePredictionBaseline();
 
     runSimulator();
 